@@ -0,0 +1,373 @@
+/*
+Benchmark for sr_resolve_collisions(), only needs srect.h:
+
+    cc -O2 -I.. bench.c -o bench
+    ./bench [-ticks N] [-max N] [-scene NAME]
+
+Every scene is generated from a fixed seed and run at each body count up to -max with every broadphase. One CSV
+line is printed per run: the time per body per tick, and from the SR_STATS tick stats the time the sort (or the grid
+or tree update) took per tick and the pairs the broadphase tested and found overlapping per tick, including the static
+index and the tilemap. The movement of the bodies is not timed.
+*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#define SR_STATS
+#define SRECT_IMPLEMENTATION
+#include "srect.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+#define BENCH_TILE 16.0f
+
+typedef struct {
+    sr_Context ctx;
+    sr_Body_Id *ids;
+    sr_Vec2 *vel, *moves;
+    int num_ids, target;
+    float width, height;
+    unsigned long seed;
+    /* level-load: ticks until the level is loaded again */
+    int reload;
+} bench_Scene;
+
+typedef struct {
+    const char *name;
+    void (*init)(bench_Scene *s);
+    void (*tick)(bench_Scene *s);
+} bench_Scene_Desc;
+
+typedef struct {
+    const char *name;
+    sr_Sweep_Direction sdir;
+} bench_Broadphase;
+
+double bench_now(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER freq, count;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+double bench_clock(void *user) {
+    (void)user;
+    return bench_now();
+}
+
+int bench_isqrt(int n) {
+    int r;
+
+    r = 1;
+    while ((r + 1) * (r + 1) <= n) {
+        ++r;
+    }
+
+    return r;
+}
+
+float bench_rand(bench_Scene *s) {
+    s->seed = (s->seed * 1103515245ul + 12345ul) & 0xFFFFFFFFul;
+
+    return (float)((s->seed >> 8) & 0xFFFFu) / 65536.0f;
+}
+
+void bench_add(bench_Scene *s, float x, float y, float w, float h, int priority, float vx, float vy) {
+    sr_Body_Id id;
+
+    id = sr_new_body(&(s->ctx), x, y, w, h, SR_TOP_LEFT, priority, 0, 0);
+    if (id < 0) {
+        fprintf(stderr, "bench: sr_new_body failed\n");
+        exit(1);
+    }
+
+    s->ids[s->num_ids] = id;
+    s->vel[s->num_ids].x = vx;
+    s->vel[s->num_ids].y = vy;
+    ++s->num_ids;
+}
+
+/* Moves every body by its velocity, turning it around at the edges of the scene */
+void bench_move(bench_Scene *s) {
+    sr_Rect r;
+    int i;
+
+    for (i = 0; i < s->num_ids; ++i) {
+        s->moves[i] = s->vel[i];
+        if ((s->vel[i].x == 0.0f && s->vel[i].y == 0.0f) || sr_get_body_rect(&r, &(s->ctx), s->ids[i]) != 0) {
+            continue;
+        }
+        if ((r.min.x < 0.0f && s->vel[i].x < 0.0f) || (r.max.x > s->width && s->vel[i].x > 0.0f)) {
+            s->vel[i].x = -s->vel[i].x;
+            s->moves[i].x = s->vel[i].x;
+        }
+        if ((r.min.y < 0.0f && s->vel[i].y < 0.0f) || (r.max.y > s->height && s->vel[i].y > 0.0f)) {
+            s->vel[i].y = -s->vel[i].y;
+            s->moves[i].y = s->vel[i].y;
+        }
+    }
+
+    sr_translate_bodies(&(s->ctx), s->ids, 0, s->num_ids, s->moves);
+}
+
+/* Platformer: 90% static tiles in floors and platforms, characters walking and falling between them */
+void bench_tilemap_init(bench_Scene *s) {
+    int num_tiles, cols, rows, i, row;
+    float y;
+
+    num_tiles = s->target * 9 / 10;
+    cols = 256;
+    rows = (num_tiles + cols - 1) / cols;
+    s->width = cols * BENCH_TILE;
+    s->height = rows * 6 * BENCH_TILE;
+
+    for (i = 0; i < num_tiles; ++i) {
+        row = i / cols;
+        y = (row * 6 + 5) * BENCH_TILE;
+        /* every other row of tiles has gaps to fall through */
+        if (row % 2 == 1 && i % 8 == 0) {
+            y -= 3 * BENCH_TILE;
+        }
+        bench_add(s, (i % cols) * BENCH_TILE, y, BENCH_TILE, BENCH_TILE, SR_PRIORITY_STATIC, 0.0f, 0.0f);
+    }
+
+    while (s->num_ids < s->target) {
+        bench_add(s, bench_rand(s) * (s->width - 24.0f), bench_rand(s) * (s->height - 24.0f), 12.0f, 24.0f, (int)(bench_rand(s) * 3), bench_rand(s) * 4.0f - 2.0f, 0.0f);
+    }
+}
+
+void bench_tilemap_tick(bench_Scene *s) {
+    int i;
+
+    for (i = 0; i < s->num_ids; ++i) {
+        if (s->vel[i].x != 0.0f) {
+            s->vel[i].y = 3.0f;
+        }
+    }
+    bench_move(s);
+}
+
+/* Bullet hell: a few players and many small fast bullets that only collide with the players */
+void bench_bullets_init(bench_Scene *s) {
+    float angle_x, angle_y;
+    int i;
+
+    s->width = 64.0f * 64.0f;
+    s->height = 64.0f * 64.0f;
+
+    for (i = 0; i < s->target; ++i) {
+        if (i % 50 == 0) {
+            bench_add(s, bench_rand(s) * s->width, bench_rand(s) * s->height, 16.0f, 16.0f, 1, bench_rand(s) * 2.0f - 1.0f, bench_rand(s) * 2.0f - 1.0f);
+        } else {
+            angle_x = bench_rand(s) * 2.0f - 1.0f;
+            angle_y = bench_rand(s) * 2.0f - 1.0f;
+            bench_add(s, bench_rand(s) * s->width, bench_rand(s) * s->height, 4.0f, 4.0f, 0, angle_x * 12.0f, angle_y * 12.0f);
+            sr_set_body_layers(&(s->ctx), s->ids[i], 2u, 1u);
+        }
+    }
+}
+
+void bench_bullets_tick(bench_Scene *s) {
+    bench_move(s);
+}
+
+/* Crowd: agents packed at about half density all walking towards the center */
+void bench_crowd_init(bench_Scene *s) {
+    int i;
+
+    s->width = (float)bench_isqrt(s->target) * 14.0f;
+    s->height = s->width;
+
+    for (i = 0; i < s->target; ++i) {
+        bench_add(s, bench_rand(s) * s->width, bench_rand(s) * s->height, 10.0f, 10.0f, (int)(bench_rand(s) * 4), 0.0f, 0.0f);
+    }
+}
+
+void bench_crowd_tick(bench_Scene *s) {
+    sr_Vec2 pos;
+    int i;
+
+    for (i = 0; i < s->num_ids; ++i) {
+        if (sr_get_body_pos(&pos, &(s->ctx), s->ids[i]) != 0) {
+            continue;
+        }
+        s->vel[i].x = pos.x < s->width / 2.0f ? 0.5f : -0.5f;
+        s->vel[i].y = pos.y < s->height / 2.0f ? 0.5f : -0.5f;
+    }
+    bench_move(s);
+}
+
+/* Open world: a few bodies spread over a large area, half of them wandering */
+void bench_sparse_init(bench_Scene *s) {
+    int i;
+
+    s->width = (float)bench_isqrt(s->target) * 200.0f;
+    s->height = s->width;
+
+    for (i = 0; i < s->target; ++i) {
+        if (i % 2 == 0) {
+            bench_add(s, bench_rand(s) * s->width, bench_rand(s) * s->height, 8.0f + bench_rand(s) * 56.0f, 8.0f + bench_rand(s) * 56.0f, SR_PRIORITY_STATIC, 0.0f, 0.0f);
+        } else {
+            bench_add(s, bench_rand(s) * s->width, bench_rand(s) * s->height, 16.0f, 16.0f, 0, bench_rand(s) * 4.0f - 2.0f, bench_rand(s) * 4.0f - 2.0f);
+        }
+    }
+}
+
+void bench_sparse_tick(bench_Scene *s) {
+    bench_move(s);
+}
+
+/* Level load: every 10 ticks the whole level is cleared and registered again in random order */
+void bench_burst_init(bench_Scene *s) {
+    s->width = (float)bench_isqrt(s->target) * 40.0f;
+    s->height = s->width;
+    s->reload = 0;
+}
+
+void bench_burst_tick(bench_Scene *s) {
+    if (s->reload == 0) {
+        sr_context_clear(&(s->ctx));
+        s->num_ids = 0;
+        while (s->num_ids < s->target) {
+            bench_add(s, bench_rand(s) * s->width, bench_rand(s) * s->height, 8.0f + bench_rand(s) * 24.0f, 8.0f + bench_rand(s) * 24.0f, (int)(bench_rand(s) * 3), bench_rand(s) * 2.0f - 1.0f, bench_rand(s) * 2.0f - 1.0f);
+        }
+        s->reload = 10;
+    }
+    --s->reload;
+    bench_move(s);
+}
+
+static const bench_Scene_Desc bench_scenes[] = {
+    {"tilemap", bench_tilemap_init, bench_tilemap_tick},
+    {"bullets", bench_bullets_init, bench_bullets_tick},
+    {"crowd", bench_crowd_init, bench_crowd_tick},
+    {"sparse", bench_sparse_init, bench_sparse_tick},
+    {"burst", bench_burst_init, bench_burst_tick}
+};
+
+static const bench_Broadphase bench_broadphases[] = {
+    {"x", SR_SWEEP_X},
+    {"y", SR_SWEEP_Y},
+    {"auto", SR_SWEEP_AUTO},
+    {"grid", SR_BROADPHASE_GRID},
+    {"tree", SR_BROADPHASE_TREE}
+};
+
+void bench_run(const bench_Scene_Desc *desc, int num_bodies, const bench_Broadphase *broadphase, int ticks) {
+    bench_Scene s;
+    sr_Tick_Stats stats;
+    double start, sort_time, total_time, tested, overlapping;
+    int t;
+
+    memset(&s, 0, sizeof(s));
+    s.seed = 1;
+    s.target = num_bodies;
+    s.ids = malloc(num_bodies * sizeof(sr_Body_Id));
+    s.vel = malloc(num_bodies * sizeof(sr_Vec2));
+    s.moves = malloc(num_bodies * sizeof(sr_Vec2));
+    if (s.ids == NULL || s.vel == NULL || s.moves == NULL || sr_context_init(&(s.ctx), num_bodies, broadphase->sdir) != 0) {
+        fprintf(stderr, "bench: out of memory\n");
+        exit(1);
+    }
+
+    sr_context_set_clock(&(s.ctx), bench_clock, NULL);
+    desc->init(&s);
+
+    sort_time = 0.0;
+    total_time = 0.0;
+    tested = 0.0;
+    overlapping = 0.0;
+    for (t = 0; t < ticks; ++t) {
+        desc->tick(&s);
+
+        start = bench_now();
+        sr_resolve_collisions(&(s.ctx));
+        total_time += bench_now() - start;
+
+        sr_get_tick_stats(&stats, &(s.ctx));
+        sort_time += stats.time_sort;
+        tested += (double)stats.pairs_visited;
+        overlapping += (double)stats.pairs_overlapping;
+    }
+
+    printf("%s,%d,%s,%d,%.3f,%.0f,%.0f,%.0f\n", desc->name, num_bodies, broadphase->name, ticks,
+        total_time * 1e9 / ((double)num_bodies * ticks), sort_time * 1e9 / ticks, tested / ticks, overlapping / ticks);
+    fflush(stdout);
+
+    sr_context_deinit(&(s.ctx));
+    free(s.ids);
+    free(s.vel);
+    free(s.moves);
+}
+
+int main(int argc, char **argv) {
+    static const int sizes[] = {1000, 5000, 20000, 50000, 200000};
+    const char *scene;
+    int ticks, max_bodies, num_scenes, i, k, b, found;
+
+    num_scenes = (int)(sizeof(bench_scenes) / sizeof(bench_scenes[0]));
+    ticks = 60;
+    max_bodies = 200000;
+    scene = NULL;
+
+    for (i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-ticks") == 0) {
+            ticks = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-max") == 0) {
+            max_bodies = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-scene") == 0) {
+            scene = argv[i + 1];
+        } else {
+            break;
+        }
+    }
+    if (i < argc || ticks <= 0) {
+        fprintf(stderr, "usage: %s [-ticks N] [-max N] [-scene tilemap|bullets|crowd|sparse|burst]\n", argv[0]);
+        return 1;
+    }
+
+    found = scene == NULL;
+    for (k = 0; k < num_scenes; ++k) {
+        if (scene != NULL && strcmp(scene, bench_scenes[k].name) == 0) {
+            found = 1;
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "bench: unknown scene %s\n", scene);
+        return 1;
+    }
+
+    printf("scene,bodies,broadphase,ticks,ns_per_body_tick,sort_ns_per_tick,pairs_tested_per_tick,pairs_overlapping_per_tick\n");
+
+    for (k = 0; k < num_scenes; ++k) {
+        if (scene != NULL && strcmp(scene, bench_scenes[k].name) != 0) {
+            continue;
+        }
+        for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])) && sizes[i] <= max_bodies; ++i) {
+            for (b = 0; b < (int)(sizeof(bench_broadphases) / sizeof(bench_broadphases[0])); ++b) {
+                bench_run(&bench_scenes[k], sizes[i], &bench_broadphases[b], ticks);
+            }
+        }
+    }
+
+    return 0;
+}
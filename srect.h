@@ -2,12 +2,29 @@
 #define SRECT_H
 
 #include <limits.h> /* INT_MAX UINT_MAX ULONG_MAX */
+#include <stddef.h> /* size_t */
 
 #define SR_PRIORITY_STATIC INT_MAX
 
+#if UINT_MAX == 4294967295
+    #define SR_U32 unsigned int
+    #define SR_I32 int
+#elif ULONG_MAX == 4294967295
+    #define SR_U32 unsigned long
+    #define SR_I32 long
+#else
+    #error "Cannot determine acceptable unsigned 32 bit integer type"
+#endif
+
 /* sr_Body flags */
 #define SR_NO_COLLISION         0x0001u
 #define SR_DISABLED             0x0002u
+#define SR_CONTINUOUS           0x0004u
+
+/* sr_Context options */
+#define SR_OPTION_STATIC_INDEX  0x0001u
+#define SR_OPTION_CONTACTS      0x0002u
+#define SR_OPTION_SLEEP         0x0004u
 
 /* sr_Body_Tick_Data flags */
 #define SR_COLLIDED             0x0001u
@@ -19,15 +36,39 @@
 #define SR_COLLIDED_RIGHT       0x0040u
 #define SR_COLLIDED_DOWN        0x0080u
 #define SR_COLLIDED_LEFT        0x0100u
+#define SR_ASLEEP               0x0200u
+
+/* float, or double with SR_DOUBLE, or fixed point with SR_FIXED_SHIFT fraction bits with SR_FIXED */
+#if defined(SR_DOUBLE) && defined(SR_FIXED)
+    #error "SR_DOUBLE and SR_FIXED can't both be defined"
+#elif defined(SR_DOUBLE)
+    typedef double sr_Scalar;
+    #define SR_SCALAR(x) ((sr_Scalar)(x))
+#elif defined(SR_FIXED)
+    #ifndef SR_FIXED_SHIFT
+        #define SR_FIXED_SHIFT 16
+    #endif
+    #if SR_FIXED_SHIFT < 1 || SR_FIXED_SHIFT > 30
+        #error "SR_FIXED_SHIFT must be in [1, 30]"
+    #endif
+    typedef SR_I32 sr_Scalar;
+    #define SR_SCALAR(x) ((sr_Scalar)((x) * (1L << SR_FIXED_SHIFT)))
+    /* products and quotients saturate to +-SR_SCALAR_MAX */
+    #define SR_SCALAR_MAX 0x7FFFFFFFL
+#else
+    typedef float sr_Scalar;
+    #define SR_SCALAR(x) ((sr_Scalar)(x))
+#endif
 
 typedef struct {
-    float x, y;
+    sr_Scalar x, y;
 } sr_Vec2;
 
 typedef struct {
     sr_Vec2 min, max;
 } sr_Rect;
 
+/* A handle holding the slot of a body and the generation of that slot, so the ids of removed bodies stay invalid */
 typedef int sr_Body_Id;
 
 typedef struct {
@@ -35,15 +76,36 @@ typedef struct {
     sr_Vec2 offset;
     int priority;
     unsigned int flags, custom_flags;
+    /* two bodies only collide if each one's category shares a bit with the other's mask */
+    unsigned int category, mask;
 } sr_Body;
 
 typedef struct {
     unsigned int flags, custom_flags;
+    /* bit i is set if child i of the body collided, see sr_set_body_children */
+    unsigned int children;
 } sr_Body_Tick_Data;
 
+/* direction is the SR_COLLIDED_UP/RIGHT/DOWN/LEFT flag id1 got, id1 is always the smaller id */
+typedef struct {
+    sr_Body_Id id1, id2;
+    unsigned int direction;
+    sr_Scalar penetration;
+} sr_Contact;
+
+/* the hit point is origin + dir * t, normal is the axis aligned normal of the side hit or 0, 0 if the ray started inside */
+typedef struct {
+    sr_Body_Id id;
+    sr_Scalar t;
+    sr_Vec2 point, normal;
+} sr_Raycast_Hit;
+
 typedef enum {
     SR_SWEEP_X,
-    SR_SWEEP_Y
+    SR_SWEEP_Y,
+    SR_BROADPHASE_GRID,
+    SR_BROADPHASE_TREE,
+    SR_SWEEP_AUTO
 } sr_Sweep_Direction;
 
 typedef enum {
@@ -58,46 +120,319 @@ typedef enum {
     SR_TOP_LEFT
 } sr_Attach_Location;
 
+typedef struct {
+    int pos;
+    int cx, cy;
+} sr_Grid_Entry;
+
+/* child1 is -1 for leaves, parent doubles as the next free node while the node is unused */
+typedef struct {
+    sr_Rect aabb;
+    int parent, child1, child2, height;
+    sr_Body_Id body;
+    int tree;
+} sr_Tree_Node;
+
+#define SR_TREE_DYNAMIC 0
+#define SR_TREE_STATIC 1
+/* SR_NO_COLLISION bodies, only queries look at them */
+#define SR_TREE_QUERY 2
+
+/* pos1 and pos2 are the sorted positions of a sweep pair, -1 for a pair of the static index */
+typedef struct {
+    sr_Body_Id id1, id2;
+    int pos1, pos2;
+} sr_Pair;
+
+#ifdef SR_STATS
+/* Filled by every sr_resolve_collisions(), the times are in the units of the clock set with sr_context_set_clock() */
+typedef struct {
+    /* bodies that are neither disabled nor asleep */
+    int num_active;
+    /* element moves of the insertion sort, and 1 if it gave up and the radix sort finished the job */
+    long sort_moves;
+    int sort_fallbacks;
+    /* pairs looked at, resolved, and skipped because both bodies are static */
+    long pairs_visited, pairs_overlapping, pairs_static;
+    /* passes over the pairs, 1 plus the iterations that had moved bodies to re-test */
+    int num_passes;
+    /* clear: tick data, sort: sweep order, grid or tree, sweep: finding pairs, resolve: the rest */
+
+    double time_clear, time_sort, time_sweep, time_resolve;
+} sr_Tick_Stats;
+
+typedef double (*sr_Clock)(void *user);
+#endif
+
+/* pairs found by one task for the sorted positions [begin, end), next is where an interrupted task resumes */
+typedef struct {
+    sr_Pair *pairs;
+    int num_pairs, pairs_cap;
+    int begin, next, end;
+    /* set when the islands resolved a pair of the chunk differently from sr_sweep_loop() */
+    int diverged;
+#ifdef SR_STATS
+    /* this task's share of the tick stats counters */
+    long pairs_visited, pairs_overlapping, pairs_static;
+#endif
+} sr_Pair_Chunk;
+
+/* a pair of an island, the next pair of each body or -1, the rects before and after it, its flags and contact */
+typedef struct {
+    sr_Body_Id id1, id2;
+    int pos1, pos2, next1, next2;
+    int overlapped, idle1, idle2, woke;
+    sr_Rect r1, r2;
+    sr_Body_Tick_Data t1, t2;
+    sr_Contact contact;
+} sr_Island_Pair;
+
+/* mark has bit 1 set for a contact of the previous tick and bit 2 for one of this tick, id1 is -1 for empty slots */
+typedef struct {
+    sr_Body_Id id1, id2;
+    unsigned int mark;
+} sr_Contact_Slot;
+
+typedef void (*sr_Task_Fn)(void *task_data, int index);
+
+/* Must call fn(task_data, i) for every i in [0, count), in any order and on any threads, and return once all calls have returned */
+typedef void (*sr_Parallel_For)(void *user, sr_Task_Fn fn, void *task_data, int count);
+
 typedef struct {
     sr_Body *bodies;
     sr_Body_Id *bodies_sorted;
     sr_Body_Tick_Data *bodies_tick_data;
+    /* hot copies of the sorted bodies, indexed by position in bodies_sorted */
+    sr_Scalar *hot_sweep_min, *hot_sweep_max, *hot_cross_min, *hot_cross_max;
+    unsigned int *hot_flags, *hot_category, *hot_mask;
+    /* scratch for the radix sort, 2 keys and 1 id per body */
+    SR_U32 *sort_keys;
+    sr_Body_Id *sort_ids;
+    /* SR_BROADPHASE_GRID: 2 buckets per body, SR_GRID_MAX_CELLS entries per body, cells covered and large list
+     * by sorted position */
+    int *grid_buckets;
+    sr_Grid_Entry *grid_entries;
+    int *grid_cells;
+    sr_Body_Id *grid_large;
+    sr_Scalar grid_cell_size;
+    /* SR_BROADPHASE_TREE: 2 nodes per body shared by a dynamic, a static and a query only tree, leaf node of each body or -1 and a
+     * bit per body that moved since its leaf was last checked */
+    sr_Tree_Node *tree_nodes;
+    int *tree_proxy;
+    SR_U32 *tree_moved;
+    int tree_roots[3];
+    int tree_free;
+    unsigned int options;
+    /* the sweep covers bodies_sorted[0, num_sweep), with SR_OPTION_STATIC_INDEX the static bodies sit after that up to
+     * num_bodies - num_free_dropped */
+    int num_sweep;
+    int static_dirty;
+    sr_Parallel_For parallel_for;
+    void *parallel_user;
+    sr_Pair_Chunk *chunks;
+    int num_chunks;
+    int parallel_stage;
+    /* island building per body and the replay check per sorted position, for island_bodies_cap bodies */
+    sr_Rect *island_rects;
+    int *island_parent, *island_ids, *island_ends, *island_heads, *island_tails, *island_row_ends, *island_first_rows;
+    int *island_cursors, *island_cursor_rows;
+    sr_Rect *island_cursor_rects;
+    SR_U32 *island_paired, *island_dirty;
+    int island_bodies_cap;
+    sr_Island_Pair *island_pairs;
+    int num_island_pairs, island_pairs_cap, num_islands;
+    /* SR_OPTION_CONTACTS: this and last tick's contacts, begins and ends, and a slot table of 4 * contacts_cap */
+
+    sr_Contact *contacts, *prev_contacts, *contact_begins, *contact_ends;
+    int num_contacts, num_prev_contacts, num_contact_begins, num_contact_ends, contacts_cap;
+    sr_Contact_Slot *contact_slots;
+    int num_contact_slots;
+    /* contacts the last tick dropped because a fixed memory context had no room for them */
+    int num_dropped_contacts;
+    /* SR_OPTION_SLEEP: ticks each body went without moving, capped at sleep_ticks */
+    int *sleep_idle;
+    int sleep_ticks;
+    /* queries: all bodies sorted by min edge on the sweep axis with hot copies of their rects and the largest max
+     * edge up to each position, rebuilt on the first query after bodies changed */
+    sr_Body_Id *query_ids;
+    sr_Scalar *query_sweep_min, *query_sweep_max, *query_cross_min, *query_cross_max, *query_reach;
+    int num_query, query_dirty;
+    /* min corner of each body at the end of the last tick, where SR_CONTINUOUS bodies sweep from */
+    sr_Vec2 *prev_min;
+    /* SR_SWEEP_AUTO: the other axis' last order, valid while num_sweep_saved matches, and the center variances */
+    int sweep_auto;
+    sr_Body_Id *sweep_saved;
+    int num_sweep_saved;
+    sr_Scalar sweep_variance[2];
+    /* passes per tick, each body's min corner at the start of the pass and whether it moved in the last one, and
+     * while sweep_indexed is set the sorted positions, the longest non-static extent and the longer static bodies */
+    int iterations;
+    sr_Vec2 *pass_min;
+    SR_U32 *moved;
+    int *sweep_pos;
+    sr_Scalar sweep_extent;
+    sr_Body_Id *sweep_long;
+    int num_sweep_long;
+    int sweep_indexed;
+    /* compound bodies: blocks of the own rect and then the children, the block and child count of each body */
+    sr_Rect *child_rects;
+    int *child_blocks, *child_counts, *free_child_blocks;
+    int num_child_blocks, num_free_child_blocks, child_blocks_cap;
+    /* the tilemap, the first tile of the merged rect covering each tile or -1 and the size of each merged rect */
+    unsigned char *tiles;
+    int *tile_rects, *tile_spans;
+    int tiles_width, tiles_height, tiles_dirty;
+    sr_Vec2 tiles_origin;
+    sr_Scalar tile_size;
+    /* handles: generation and body per slot, slot per body and the free slots and removed bodies as stacks.
+     * free_bodies[0, num_free_dropped) are no longer in bodies_sorted. */
+    unsigned int *slot_generation;
+    int *slot_body, *body_slot, *free_slots, *free_bodies;
+    int num_slots, num_free_slots, num_free_bodies, num_free_dropped;
     int num_bodies;
     int bodies_cap;
+    /* the optional per body arrays the context holds, see sr_context_features */
+    unsigned int features;
+    /* made by sr_context_init_with_memory, nothing is allocated or freed */
+    int fixed_memory;
+#ifdef SR_STATS
+    /* the stats of the last tick, the clock and the time the current phase started at */
+    sr_Tick_Stats stats;
+    sr_Clock clock;
+    void *clock_user;
+    double phase_start;
+#endif
     sr_Sweep_Direction sweep_direction;
 } sr_Context;
 
+/* the start of every snapshot, the state arrays follow it back to back */
+typedef struct {
+    size_t bytes;
+    int is_delta;
+    int num_bodies, bodies_cap, num_sweep, static_dirty, num_sweep_saved, sweep_auto;
+    unsigned int features;
+    sr_Sweep_Direction sweep_direction;
+    sr_Scalar sweep_variance[2];
+    int tree_roots[3], tree_free, num_tree_nodes;
+    int num_slots, num_free_slots, num_free_bodies, num_free_dropped;
+    int num_contacts, num_contact_begins, num_contact_ends;
+    int num_child_blocks, num_free_child_blocks;
+    int num_tiles;
+} sr_Snapshot_Header;
+
+/* rooms stepped together by sr_world_step, each a fixed memory context in one block */
+typedef struct {
+    sr_Context *rooms;
+    int num_rooms;
+    /* the rooms largest first, the task of each room and the rooms grouped by task with each task's load */
+    int *room_order, *room_tasks, *task_rooms;
+    int *task_ends;
+    long *task_loads;
+    int num_tasks;
+    sr_Parallel_For parallel_for;
+    void *parallel_user;
+    void *memory;
+} sr_World;
+
 int sr_context_init(sr_Context *ctx, int expected_num_bodies, sr_Sweep_Direction sdir);
 
+/* Bytes sr_context_init_with_memory needs to hold max_bodies bodies with the broadphase sdir and the options */
+size_t sr_context_memory_size(int max_bodies, sr_Sweep_Direction sdir, unsigned int options);
+
+int sr_context_init_with_memory(sr_Context *ctx, void *memory, size_t bytes, sr_Sweep_Direction sdir, unsigned int options);
+
+int sr_context_reserve(sr_Context *ctx, int num_bodies);
+
 void sr_context_deinit(sr_Context *ctx);
 
 void sr_context_clear(sr_Context *ctx);
 
-sr_Body_Id sr_new_body(sr_Context *ctx, float xpos, float ypos, float xdim, float ydim, sr_Attach_Location loc, int priority, unsigned int flags, unsigned int custom_flags);
+/* Returns -1 and changes nothing if a context made by sr_context_init_with_memory has no room for sdir */
+int sr_context_set_sweep_direction(sr_Context *ctx, sr_Sweep_Direction sdir);
+
+int sr_context_set_grid_cell_size(sr_Context *ctx, sr_Scalar cell_size);
+
+/* Returns -1 and changes nothing if a context made by sr_context_init_with_memory has no room for the options */
+int sr_context_set_options(sr_Context *ctx, unsigned int options);
+
+void sr_context_set_sleep_ticks(sr_Context *ctx, int sleep_ticks);
+
+int sr_context_set_parallel_for(sr_Context *ctx, sr_Parallel_For parallel_for, void *user, int num_tasks);
+
+void sr_context_set_iterations(sr_Context *ctx, int iterations);
+
+/* tiles[y * width + x] is the tile whose min corner is origin + (x, y) * tile_size, see the README */
+int sr_context_set_tilemap(sr_Context *ctx, const unsigned char *tiles, int width, int height, sr_Vec2 origin, sr_Scalar tile_size);
+
+int sr_set_tile(sr_Context *ctx, int x, int y, unsigned char tile);
+
+int sr_get_tile(const sr_Context *ctx, int x, int y);
+
+sr_Body_Id sr_new_body(sr_Context *ctx, sr_Scalar xpos, sr_Scalar ypos, sr_Scalar xdim, sr_Scalar ydim, sr_Attach_Location loc, int priority, unsigned int flags, unsigned int custom_flags);
 
 sr_Body_Id sr_register_body(sr_Context *ctx, sr_Body b);
 
-int sr_place_body(sr_Context *ctx, sr_Body_Id id, float xpos, float ypos);
+int sr_place_body(sr_Context *ctx, sr_Body_Id id, sr_Scalar xpos, sr_Scalar ypos);
 
-int sr_translate_body(sr_Context *ctx, sr_Body_Id id, float xmove, float ymove);
+int sr_translate_body(sr_Context *ctx, sr_Body_Id id, sr_Scalar xmove, sr_Scalar ymove);
+
+int sr_set_body_layers(sr_Context *ctx, sr_Body_Id id, unsigned int category, unsigned int mask);
+
+/* Makes the body a compound of up to SR_MAX_CHILDREN rects relative to its position, 0 restores its own rect.
+ * Returns -1 if a fixed memory context has no room for another compound body. */
+int sr_set_body_children(sr_Context *ctx, sr_Body_Id id, const sr_Rect *children, int num_children);
+
+int sr_remove_body(sr_Context *ctx, sr_Body_Id id);
+
+void sr_context_compact(sr_Context *ctx);
+
+/* Snapshots hold the bodies, handles and everything else a tick depends on, but not the settings, see the README */
+
+size_t sr_context_snapshot_size(const sr_Context *ctx);
+
+int sr_context_save(void *snapshot_out, size_t bytes, const sr_Context *ctx);
+
+int sr_context_restore(sr_Context *ctx, const void *snapshot);
+
+int sr_context_save_delta(void *delta_out, size_t bytes, const sr_Context *ctx, const void *base);
+
+int sr_context_restore_delta(sr_Context *ctx, const void *base, const void *delta);
+
+size_t sr_snapshot_bytes(const void *snapshot);
+
+/* The batch functions work on ids[0, count), or on the body indices [first, first + count) if ids is NULL.
+ * They return -1 and change nothing if a body doesn't exist. */
+
+
+int sr_place_bodies(sr_Context *ctx, const sr_Body_Id *ids, int first, int count, const sr_Vec2 *positions);
+
+int sr_translate_bodies(sr_Context *ctx, const sr_Body_Id *ids, int first, int count, const sr_Vec2 *moves);
 
 int sr_get_body_pos(sr_Vec2 *pos_out, const sr_Context *ctx, sr_Body_Id id);
 
-int sr_get_body_pos_comp(float *xpos_out, float *ypos_out, const sr_Context *ctx, sr_Body_Id id);
+int sr_get_body_pos_comp(sr_Scalar *xpos_out, sr_Scalar *ypos_out, const sr_Context *ctx, sr_Body_Id id);
 
 int sr_get_body_dim(sr_Vec2 *dim_out, const sr_Context *ctx, sr_Body_Id id);
 
-int sr_get_body_dim_comp(float *xdim_out, float *ydim_out, const sr_Context *ctx, sr_Body_Id id);
+int sr_get_body_dim_comp(sr_Scalar *xdim_out, sr_Scalar *ydim_out, const sr_Context *ctx, sr_Body_Id id);
 
 int sr_get_body_rect(sr_Rect *rect_out, const sr_Context *ctx, sr_Body_Id id);
 
-int sr_get_body_rect_comp(float *xmin_out, float *ymin_out, float *xmax_out, float *ymax_out, const sr_Context *ctx, sr_Body_Id id);
+int sr_get_body_rect_comp(sr_Scalar *xmin_out, sr_Scalar *ymin_out, sr_Scalar *xmax_out, sr_Scalar *ymax_out, const sr_Context *ctx, sr_Body_Id id);
+
+int sr_get_body_child_rect(sr_Rect *rect_out, const sr_Context *ctx, sr_Body_Id id, int child);
+
+/* Write 2 sr_Scalars (x, y) or 4 sr_Scalars (xmin, ymin, xmax, ymax) per body, each body stride bytes after the last */
+
+int sr_get_bodies_pos(void *pos_out, int stride, const sr_Context *ctx, const sr_Body_Id *ids, int first, int count);
+
+int sr_get_bodies_rect(void *rect_out, int stride, const sr_Context *ctx, const sr_Body_Id *ids, int first, int count);
 
 int sr_do_bodies_overlap(sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2);
 
 int sr_get_body_to_body_vector(sr_Vec2 *vec_out, sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2);
 
-int sr_get_body_to_body_vector_comp(float *xvec_out, float *yvec_out, sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2);
+int sr_get_body_to_body_vector_comp(sr_Scalar *xvec_out, sr_Scalar *yvec_out, sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2);
 
 int sr_get_body_tick_data(sr_Body_Tick_Data *data_out, sr_Context *ctx, sr_Body_Id id);
 
@@ -121,28 +456,78 @@ int sr_did_body_collide_down(sr_Context *ctx, sr_Body_Id id);
 
 int sr_did_body_collide_left(sr_Context *ctx, sr_Body_Id id);
 
+int sr_get_contacts(const sr_Contact **contacts_out, int *num_contacts_out, const sr_Context *ctx);
+
+int sr_get_contact_begins(const sr_Contact **contacts_out, int *num_contacts_out, const sr_Context *ctx);
+
+int sr_get_contact_ends(const sr_Contact **contacts_out, int *num_contacts_out, const sr_Context *ctx);
+
+int sr_raycast(sr_Raycast_Hit *hit_out, sr_Context *ctx, sr_Vec2 origin, sr_Vec2 dir, sr_Scalar max_t, unsigned int filter);
+
+int sr_raycast_all(sr_Raycast_Hit *hits_out, int max_hits, sr_Context *ctx, sr_Vec2 origin, sr_Vec2 dir, sr_Scalar max_t, unsigned int filter);
+
+int sr_query_rect(sr_Body_Id *ids_out, int max_out, sr_Context *ctx, sr_Rect rect, unsigned int filter);
+
+int sr_query_point(sr_Body_Id *ids_out, int max_out, sr_Context *ctx, sr_Vec2 point, unsigned int filter);
+
+int sr_query_rects(sr_Body_Id *ids_out, int max_out, int *counts_out, sr_Context *ctx, const sr_Rect *rects, int num_rects, unsigned int filter);
+
 void sr_resolve_collisions(sr_Context *ctx);
 
-#endif /* #ifndef SRECT_H */
+/* Makes num_rooms rooms in one allocation, room i holds room_bodies[i] bodies and works like a context made by
+ * sr_context_init_with_memory with sdir and options */
+int sr_world_init(sr_World *world, const int *room_bodies, int num_rooms, sr_Sweep_Direction sdir, unsigned int options);
 
-#ifdef SRECT_IMPLEMENTATION
+void sr_world_deinit(sr_World *world);
 
-#include <stddef.h> /* NULL */
-#include <string.h> /* memcpy() memset()  */
-#include <float.h> /* FLT_DIG */
+/* The room's context, or NULL if there is no such room */
+sr_Context *sr_world_get_room(sr_World *world, int room);
 
-#if UINT_MAX == 4294967295
-    #define SR_U32 unsigned int
-#elif ULONG_MAX == 4294967295
-    #define SR_U32 unsigned long
-#else
-    #error "Cannot determine acceptable unsigned 32 bit integer type"
+/* Spreads the rooms over num_tasks tasks of parallel_for, the largest rooms first */
+int sr_world_set_parallel_for(sr_World *world, sr_Parallel_For parallel_for, void *user, int num_tasks);
+
+/* Calls sr_resolve_collisions for every room */
+void sr_world_step(sr_World *world);
+
+/* The task the room ran on in the last step, or -1 if there is no such room */
+int sr_world_get_room_task(const sr_World *world, int room);
+
+#ifdef SR_STATS
+/* Without a clock the phase times stay 0 */
+void sr_context_set_clock(sr_Context *ctx, sr_Clock clock, void *user);
+
+int sr_get_tick_stats(sr_Tick_Stats *stats_out, const sr_Context *ctx);
+
+/* Sets the clock of every room */
+void sr_world_set_clock(sr_World *world, sr_Clock clock, void *user);
+
+int sr_world_get_room_stats(sr_Tick_Stats *stats_out, const sr_World *world, int room);
 #endif
 
-#if FLT_DIG != 6
+#endif /* #ifndef SRECT_H */
+
+#ifdef SRECT_IMPLEMENTATION
+
+#include <stddef.h> /* NULL size_t */
+#include <string.h> /* memcpy() memmove() memset()  */
+#include <float.h> /* FLT_DIG DBL_DIG */
+
+/* the radix sort keys are the bits of the scalars */
+#if defined(SR_DOUBLE) && DBL_DIG != 15
+    #error "double does not appear to be 64 bit"
+#elif !defined(SR_DOUBLE) && !defined(SR_FIXED) && FLT_DIG != 6
     #error "float does not appear to be 32 bit"
 #endif
 
+/* 32 bit words per radix sort key */
+#define SR_SORT_KEY_WORDS (sizeof(sr_Scalar) / 4)
+
+/* the optional per body arrays of a context, contacts only count for sr_context_init_with_memory */
+#define SR_FEATURE_GRID     0x0001u
+#define SR_FEATURE_TREE     0x0002u
+#define SR_FEATURE_SLEEP    0x0004u
+#define SR_FEATURE_CONTACTS 0x0008u
+
 #if defined(SR_REALLOC) && !defined(SR_FREE) || !defined(SR_REALLOC) && defined(SR_FREE)
     #error "Custom allocator support requires defining both SR_REALLOC and SR_FREE"
 #endif
@@ -157,19 +542,222 @@ void sr_resolve_collisions(sr_Context *ctx);
     #define SR_FREE(c, ptr) free(ptr)
 #endif
 
+#ifndef SR_SORT_MOVES_PER_BODY
+    #define SR_SORT_MOVES_PER_BODY 8
+#endif
+
+#ifndef SR_SORT_MIN_MOVES
+    #define SR_SORT_MIN_MOVES 256
+#endif
+
+#ifndef SR_GRID_MAX_CELLS
+    #define SR_GRID_MAX_CELLS 4
+#endif
+
+#ifndef SR_TREE_MARGIN
+    #define SR_TREE_MARGIN SR_SCALAR(4)
+#endif
+
+#ifndef SR_TREE_STACK_SIZE
+    #define SR_TREE_STACK_SIZE 256
+#endif
+
+/* child rects of a compound body, each gets a bit in sr_Body_Tick_Data.children */
+#ifndef SR_MAX_CHILDREN
+    #define SR_MAX_CHILDREN 4
+#endif
+
+#if SR_MAX_CHILDREN > 32
+    #error "SR_MAX_CHILDREN must fit the bits of sr_Body_Tick_Data.children"
+#endif
+
+#define SR_CHILD_BLOCK (SR_MAX_CHILDREN + 1)
+
+#ifndef SR_SLEEP_TOLERANCE
+    #define SR_SLEEP_TOLERANCE (SR_SCALAR(1) / 100)
+#endif
+
+/* bits of an sr_Body_Id holding the slot, the generation gets the remaining bits up to the sign bit */
+#ifndef SR_ID_INDEX_BITS
+    #define SR_ID_INDEX_BITS 22
+#endif
+
+#define SR_ID_INDEX_MASK ((1 << SR_ID_INDEX_BITS) - 1)
+#define SR_ID_GENERATION_MASK ((1u << (31 - SR_ID_INDEX_BITS)) - 1u)
+
+/* SR_SWEEP_AUTO switches axis once the other axis' variance exceeds the current one's by this factor */
+#ifndef SR_SWEEP_AUTO_RATIO
+    #define SR_SWEEP_AUTO_RATIO 1.5f
+#endif
+
+#ifndef SR_CONTINUOUS_SLOP
+    #define SR_CONTINUOUS_SLOP (SR_SCALAR(1) / 100)
+#endif
+
+/* the per body arrays start on multiples of this, and sr_context_init_with_memory aligns the buffer to it */
+#ifndef SR_CACHE_LINE
+    #define SR_CACHE_LINE 64
+#endif
+
+/* contacts a context made by sr_context_init_with_memory holds per body, rounded up to a power of two */
+#ifndef SR_FIXED_CONTACTS_PER_BODY
+    #define SR_FIXED_CONTACTS_PER_BODY 2
+#endif
+
+/* a context made by sr_context_init_with_memory has room for one compound body per this many bodies */
+#ifndef SR_FIXED_BODIES_PER_COMPOUND
+    #define SR_FIXED_BODIES_PER_COMPOUND 8
+#endif
+
+/* delta snapshots store the state arrays in pieces of this many bytes, only the pieces that differ from the base */
+#ifndef SR_SNAPSHOT_CHUNK
+    #define SR_SNAPSHOT_CHUNK 64
+#endif
+
+/* SR_STAT(statement) only compiles statement with SR_STATS defined */
+#ifdef SR_STATS
+    #define SR_STAT(statement) statement
+#else
+    #define SR_STAT(statement)
+#endif
+
 #ifndef SR_ASSERT
     #include <assert.h>
     #define SR_ASSERT(e) assert(e)
 #endif
 
-float sr_fabsf(float num) {
-    SR_U32 bits;
+/* the SIMD sweep compares 32 bit floats, or 32 bit ints with SR_FIXED */
+#if defined(SR_DOUBLE)
+    #undef SR_AVX2
+    #undef SR_SSE2
+#elif !defined(SR_NO_SIMD) && !defined(SR_AVX2) && !defined(SR_SSE2)
+    #if defined(__AVX2__)
+        #define SR_AVX2
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define SR_SSE2
+    #endif
+#endif
+
+#if defined(SR_AVX2)
+    #include <immintrin.h>
+    #define SR_SIMD_WIDTH 8
+#elif defined(SR_SSE2)
+    #include <emmintrin.h>
+    #define SR_SIMD_WIDTH 4
+#endif
+
+/* a vector of scalars, and loading, broadcasting and comparing them into a float mask */
+#if defined(SR_AVX2) && defined(SR_FIXED)
+    #define SR_SIMD_SCALARS __m256i
+    #define SR_SIMD_SET1(x) _mm256_set1_epi32(x)
+    #define SR_SIMD_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+    #define SR_SIMD_GT(a, b) _mm256_castsi256_ps(_mm256_cmpgt_epi32(a, b))
+#elif defined(SR_AVX2)
+    #define SR_SIMD_SCALARS __m256
+    #define SR_SIMD_SET1(x) _mm256_set1_ps(x)
+    #define SR_SIMD_LOAD(p) _mm256_loadu_ps(p)
+    #define SR_SIMD_GT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#elif defined(SR_SSE2) && defined(SR_FIXED)
+    #define SR_SIMD_SCALARS __m128i
+    #define SR_SIMD_SET1(x) _mm_set1_epi32(x)
+    #define SR_SIMD_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+    #define SR_SIMD_GT(a, b) _mm_castsi128_ps(_mm_cmpgt_epi32(a, b))
+#elif defined(SR_SSE2)
+    #define SR_SIMD_SCALARS __m128
+    #define SR_SIMD_SET1(x) _mm_set1_ps(x)
+    #define SR_SIMD_LOAD(p) _mm_loadu_ps(p)
+    #define SR_SIMD_GT(a, b) _mm_cmpgt_ps(a, b)
+#endif
+
+sr_Scalar sr_abs(sr_Scalar num) {
+    /* 0 - num turns -0 into 0 like fabs() */
+    return num <= 0 ? 0 - num : num;
+}
+
+#ifdef SR_FIXED
+/* The fixed point math works on the magnitudes and rounds toward 0, whatever the platform does with negative ints */
+
+SR_U32 sr_fixed_magnitude(sr_Scalar num) {
+    return num < 0 ? 0u - (SR_U32)num : (SR_U32)num;
+}
+
+sr_Scalar sr_fixed_signed(SR_U32 magnitude, int negative) {
+    if (magnitude > (SR_U32)SR_SCALAR_MAX) {
+        magnitude = (SR_U32)SR_SCALAR_MAX;
+    }
+
+    return negative ? -(sr_Scalar)magnitude : (sr_Scalar)magnitude;
+}
+
+sr_Scalar sr_half(sr_Scalar num) {
+    return sr_fixed_signed(sr_fixed_magnitude(num) / 2u, num < 0);
+}
+
+/* Multiplies the 16 bit halves into a 64 bit product split into hi and lo, then shifts out the fraction bits */
+sr_Scalar sr_mul(sr_Scalar a, sr_Scalar b) {
+    SR_U32 ua, ub, lo, mid, mid_carry, hi, sum;
+
+    ua = sr_fixed_magnitude(a);
+    ub = sr_fixed_magnitude(b);
+
+    lo = (ua & 0xFFFFu) * (ub & 0xFFFFu);
+    mid = (ua & 0xFFFFu) * (ub >> 16);
+    sum = mid + (ua >> 16) * (ub & 0xFFFFu);
+    mid_carry = sum < mid;
+    mid = sum;
+    hi = (ua >> 16) * (ub >> 16) + (mid >> 16) + (mid_carry << 16);
+    sum = lo + ((mid << 16) & 0xFFFFFFFFul);
+    hi += sum < lo;
+    lo = sum;
+
+    if (hi >> SR_FIXED_SHIFT != 0) {
+        return sr_fixed_signed((SR_U32)SR_SCALAR_MAX, (a < 0) != (b < 0));
+    }
+
+    return sr_fixed_signed(((hi << (32 - SR_FIXED_SHIFT)) & 0xFFFFFFFFul) | (lo >> SR_FIXED_SHIFT), (a < 0) != (b < 0));
+}
+
+/* Long division of the magnitude of a shifted up by the fraction bits, one quotient bit per step */
+sr_Scalar sr_div(sr_Scalar a, sr_Scalar b) {
+    SR_U32 ua, ub, hi, lo, q, carry;
+    int i;
+
+    ua = sr_fixed_magnitude(a);
+    ub = sr_fixed_magnitude(b);
+    hi = ua >> (32 - SR_FIXED_SHIFT);
+    lo = (ua << SR_FIXED_SHIFT) & 0xFFFFFFFFul;
+
+    if (ub == 0 || hi >= ub) {
+        return a == 0 ? 0 : sr_fixed_signed((SR_U32)SR_SCALAR_MAX, (a < 0) != (b < 0));
+    }
+
+    q = 0;
+    for (i = 0; i < 32; ++i) {
+        carry = hi >> 31;
+        hi = ((hi << 1) & 0xFFFFFFFFul) | (lo >> 31);
+        lo = (lo << 1) & 0xFFFFFFFFul;
+        q = (q << 1) & 0xFFFFFFFFul;
+        if (carry || hi >= ub) {
+            hi = (hi - ub) & 0xFFFFFFFFul;
+            q |= 1u;
+        }
+    }
+
+    return sr_fixed_signed(q, (a < 0) != (b < 0));
+}
+#else
+sr_Scalar sr_half(sr_Scalar num) {
+    return num / 2;
+}
 
-    bits = *(SR_U32 *)&num;
-    bits &= 0x7FFFFFFFul;
+sr_Scalar sr_mul(sr_Scalar a, sr_Scalar b) {
+    return a * b;
+}
 
-    return *(float *)&bits;
+sr_Scalar sr_div(sr_Scalar a, sr_Scalar b) {
+    return a / b;
 }
+#endif
 
 int sr_is_b1_xmin_edge_less(const sr_Context *ctx, sr_Body_Id b1, sr_Body_Id b2) {
     if (ctx->bodies[b1].r.min.x < ctx->bodies[b2].r.min.x) {
@@ -187,122 +775,711 @@ int sr_is_b1_ymin_edge_less(const sr_Context *ctx, sr_Body_Id b1, sr_Body_Id b2)
     }
 }
 
-void sr_stable_sort(sr_Context *ctx) {
+/* Index of the word holding the sign and the exponent when a double is copied into 2 SR_U32s */
+int sr_double_high_word(void) {
+    double one;
+    SR_U32 words[2];
+
+    one = 1.0;
+    memcpy(words, &one, sizeof(words));
+
+    return words[1] == 0x3FF00000ul ? 1 : 0;
+}
+
+/* Writes the SR_SORT_KEY_WORDS words of the key of f, lowest word first, keys compare like the scalars do */
+void sr_scalar_sort_key(SR_U32 *key_out, sr_Scalar f) {
+#ifdef SR_FIXED
+    /* flipping the sign bit of the two's complement bits orders them like unsigned ints */
+    key_out[0] = (SR_U32)f ^ 0x80000000ul;
+#else
+    SR_U32 words[SR_SORT_KEY_WORDS];
+    int i, high;
+
+    /* -0 and 0 compare equal, so they must get the same key to keep the sort stable */
+    if (f == 0) {
+        f = 0;
+    }
+    memcpy(words, &f, sizeof(words));
+
+    high = SR_SORT_KEY_WORDS == 2 ? sr_double_high_word() : 0;
+    for (i = 0; i < (int)SR_SORT_KEY_WORDS; ++i) {
+        key_out[i] = words[SR_SORT_KEY_WORDS == 2 ? i ^ !high : i];
+    }
+
+    if (key_out[SR_SORT_KEY_WORDS - 1] & 0x80000000ul) {
+        for (i = 0; i < (int)SR_SORT_KEY_WORDS; ++i) {
+            key_out[i] = ~key_out[i] & 0xFFFFFFFFul;
+        }
+    } else {
+        key_out[SR_SORT_KEY_WORDS - 1] |= 0x80000000ul;
+    }
+#endif
+}
+
+/* LSD radix sort of ids[0, num_ids) by min edge on the sweep axis, 8 bits per pass; equal keys keep their current order */
+void sr_radix_sort(sr_Context *ctx, sr_Body_Id *ids, int num_ids) {
+    int counts[4 * SR_SORT_KEY_WORDS][256];
+    SR_U32 *keys_in, *keys_out, *keys_temp;
+    sr_Body_Id *ids_in, *ids_out, *ids_temp;
+    int i, w, pass, sum, count;
+    unsigned int word, shift, byte;
+
+    memset(counts, 0, sizeof(counts));
+
+    keys_in = ctx->sort_keys;
+    keys_out = ctx->sort_keys + num_ids * SR_SORT_KEY_WORDS;
+    ids_in = ids;
+    ids_out = ctx->sort_ids;
+
+    for (i = 0; i < num_ids; ++i) {
+        if (ctx->sweep_direction == SR_SWEEP_X) {
+            sr_scalar_sort_key(keys_in + i * SR_SORT_KEY_WORDS, ctx->bodies[ids_in[i]].r.min.x);
+        } else {
+            sr_scalar_sort_key(keys_in + i * SR_SORT_KEY_WORDS, ctx->bodies[ids_in[i]].r.min.y);
+        }
+        for (w = 0; w < (int)SR_SORT_KEY_WORDS; ++w) {
+            ++counts[4 * w][keys_in[i * SR_SORT_KEY_WORDS + w] & 0xFFu];
+            ++counts[4 * w + 1][(keys_in[i * SR_SORT_KEY_WORDS + w] >> 8) & 0xFFu];
+            ++counts[4 * w + 2][(keys_in[i * SR_SORT_KEY_WORDS + w] >> 16) & 0xFFu];
+            ++counts[4 * w + 3][(keys_in[i * SR_SORT_KEY_WORDS + w] >> 24) & 0xFFu];
+        }
+    }
+
+    for (pass = 0; pass < 4 * (int)SR_SORT_KEY_WORDS; ++pass) {
+        word = pass / 4u;
+        shift = pass % 4u * 8u;
+
+        /* every key shares this byte, the pass would not move anything */
+        if (counts[pass][(keys_in[word] >> shift) & 0xFFu] == num_ids) {
+            continue;
+        }
+
+        sum = 0;
+        for (i = 0; i < 256; ++i) {
+            count = counts[pass][i];
+            counts[pass][i] = sum;
+            sum += count;
+        }
+
+        for (i = 0; i < num_ids; ++i) {
+            byte = (keys_in[i * SR_SORT_KEY_WORDS + word] >> shift) & 0xFFu;
+            for (w = 0; w < (int)SR_SORT_KEY_WORDS; ++w) {
+                keys_out[counts[pass][byte] * SR_SORT_KEY_WORDS + w] = keys_in[i * SR_SORT_KEY_WORDS + w];
+            }
+            ids_out[counts[pass][byte]] = ids_in[i];
+            ++counts[pass][byte];
+        }
+
+        keys_temp = keys_in;
+        keys_in = keys_out;
+        keys_out = keys_temp;
+        ids_temp = ids_in;
+        ids_in = ids_out;
+        ids_out = ids_temp;
+    }
+
+    if (ids_in != ids) {
+        memcpy(ids, ids_in, num_ids * sizeof(sr_Body_Id));
+    }
+}
+
+/* Returns -1 if it gave up after max_moves element moves, leaving ids partially sorted */
+int sr_insertion_sort(sr_Context *ctx, sr_Body_Id *ids, int num_ids, long max_moves) {
     sr_Body_Id temp;
+    long moves;
     int i, j;
 
+    moves = 0;
+
     if (ctx->sweep_direction == SR_SWEEP_X) {
-        for (i = 1; i < ctx->num_bodies; ++i) {
-            temp = ctx->bodies_sorted[i];
+        for (i = 1; i < num_ids; ++i) {
+            temp = ids[i];
             j = i - 1;
 
-            while(j >= 0 && sr_is_b1_xmin_edge_less(ctx, temp, ctx->bodies_sorted[j])) {
-                ctx->bodies_sorted[j + 1] = ctx->bodies_sorted[j];
+            while(j >= 0 && sr_is_b1_xmin_edge_less(ctx, temp, ids[j])) {
+                ids[j + 1] = ids[j];
                 --j;
             }
 
-            ctx->bodies_sorted[j + 1] = temp;
+            ids[j + 1] = temp;
+
+            moves += i - 1 - j;
+            if (moves > max_moves) {
+                SR_STAT(if (ids == ctx->bodies_sorted) ctx->stats.sort_moves += moves;)
+                return -1;
+            }
         }
     } else {
-        for (i = 1; i < ctx->num_bodies; ++i) {
-            temp = ctx->bodies_sorted[i];
+        for (i = 1; i < num_ids; ++i) {
+            temp = ids[i];
             j = i - 1;
 
-            while(j >= 0 && sr_is_b1_ymin_edge_less(ctx, temp, ctx->bodies_sorted[j])) {
-                ctx->bodies_sorted[j + 1] = ctx->bodies_sorted[j];
+            while(j >= 0 && sr_is_b1_ymin_edge_less(ctx, temp, ids[j])) {
+                ids[j + 1] = ids[j];
                 --j;
             }
 
-            ctx->bodies_sorted[j + 1] = temp;
+            ids[j + 1] = temp;
+
+            moves += i - 1 - j;
+            if (moves > max_moves) {
+                SR_STAT(if (ids == ctx->bodies_sorted) ctx->stats.sort_moves += moves;)
+                return -1;
+            }
         }
     }
-}
 
-int sr_do_rects_overlap(sr_Rect r1, sr_Rect r2) {
-    return !(r1.min.x > r2.max.x || r1.max.x < r2.min.x || r1.min.y > r2.max.y || r1.max.y < r2.min.y);
+    SR_STAT(if (ids == ctx->bodies_sorted) ctx->stats.sort_moves += moves;)
+
+    return 0;
 }
 
-void sr_translate_body_direct(sr_Body *b, float xmove, float ymove) {
-    b->r.min.x += xmove;
-    b->r.min.y += ymove;
-    b->r.max.x += xmove;
-    b->r.max.y += ymove;
+/* Insertion sort that leaves the rest to the radix sort after SR_SORT_MOVES_PER_BODY moves per body */
+
+void sr_stable_sort(sr_Context *ctx, sr_Body_Id *ids, int num_ids) {
+    if (sr_insertion_sort(ctx, ids, num_ids, (long)num_ids * SR_SORT_MOVES_PER_BODY + SR_SORT_MIN_MOVES) != 0) {
+        SR_STAT(if (ids == ctx->bodies_sorted) ctx->stats.sort_fallbacks = 1;)
+        sr_radix_sort(ctx, ids, num_ids);
+    }
 }
 
-void sr_resolve_bodies(sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
-    sr_Body *b1, *b2;
-    sr_Body_Tick_Data *b1t, *b2t;
-    sr_Vec2 b2_to_b1;
-    float b1_extent, b2_extent, x_overlap, y_overlap;
+/* Copies the rect and flags of the body at sorted position ind into the hot arrays */
+void sr_store_hot(sr_Context *ctx, int ind) {
+    const sr_Body *b;
 
-    b1 = &(ctx->bodies[id1]);
-    b2 = &(ctx->bodies[id2]);
+    b = &(ctx->bodies[ctx->bodies_sorted[ind]]);
+
+    if (ctx->sweep_direction == SR_SWEEP_X) {
+        ctx->hot_sweep_min[ind] = b->r.min.x;
+        ctx->hot_sweep_max[ind] = b->r.max.x;
+        ctx->hot_cross_min[ind] = b->r.min.y;
+        ctx->hot_cross_max[ind] = b->r.max.y;
+    } else {
+        ctx->hot_sweep_min[ind] = b->r.min.y;
+        ctx->hot_sweep_max[ind] = b->r.max.y;
+        ctx->hot_cross_min[ind] = b->r.min.x;
+        ctx->hot_cross_max[ind] = b->r.max.x;
+    }
+    ctx->hot_flags[ind] = (b->flags & (SR_DISABLED | SR_NO_COLLISION)) | (ctx->bodies_tick_data[ctx->bodies_sorted[ind]].flags & SR_ASLEEP);
+    ctx->hot_category[ind] = b->category;
+    ctx->hot_mask[ind] = b->mask;
+}
 
-    b1t = &(ctx->bodies_tick_data[id1]);
-    b2t = &(ctx->bodies_tick_data[id2]);
+void sr_gather_hot(sr_Context *ctx) {
+    const sr_Rect *r;
+#ifdef SR_FIXED
+    sr_Vec2 lo, hi;
+#else
+    double x, y, sum_x, sum_y, sum_xx, sum_yy;
+#endif
+    int i;
 
-    if (b1->priority == SR_PRIORITY_STATIC && b2->priority == SR_PRIORITY_STATIC) {
+    if (!ctx->sweep_auto) {
+        for (i = 0; i < ctx->num_sweep; ++i) {
+            sr_store_hot(ctx, i);
+        }
         return;
     }
 
-    b1t->flags |= SR_COLLIDED;
-    b2t->flags |= SR_COLLIDED;
+#ifdef SR_FIXED
+    /* the squares of the variance would overflow, so fixed point measures the spread by the range of the min corners */
+    for (i = 0; i < ctx->num_sweep; ++i) {
+        sr_store_hot(ctx, i);
+        r = &(ctx->bodies[ctx->bodies_sorted[i]].r);
+        if (i == 0) {
+            lo = r->min;
+            hi = r->min;
+        }
+        lo.x = r->min.x < lo.x ? r->min.x : lo.x;
+        lo.y = r->min.y < lo.y ? r->min.y : lo.y;
+        hi.x = r->min.x > hi.x ? r->min.x : hi.x;
+        hi.y = r->min.y > hi.y ? r->min.y : hi.y;
+    }
 
-    b1t->custom_flags |= b2->custom_flags;
-    b2t->custom_flags |= b1->custom_flags;
+    if (ctx->num_sweep > 0) {
+        ctx->sweep_variance[0] = sr_half(hi.x) - sr_half(lo.x);
+        ctx->sweep_variance[1] = sr_half(hi.y) - sr_half(lo.y);
+    }
+#else
 
-    b2_to_b1.x = (b1->r.min.x + b1->r.max.x) / 2.0f - (b2->r.min.x + b2->r.max.x) / 2.0f;
-    b2_to_b1.y = (b1->r.min.y + b1->r.max.y) / 2.0f - (b2->r.min.y + b2->r.max.y) / 2.0f;
+    sum_x = 0.0;
+    sum_y = 0.0;
+    sum_xx = 0.0;
+    sum_yy = 0.0;
+    for (i = 0; i < ctx->num_sweep; ++i) {
+        sr_store_hot(ctx, i);
+        r = &(ctx->bodies[ctx->bodies_sorted[i]].r);
+        x = 0.5 * ((double)r->min.x + r->max.x);
+        y = 0.5 * ((double)r->min.y + r->max.y);
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_yy += y * y;
+    }
 
-    b1_extent = (b1->r.max.x - b1->r.min.x) / 2.0f;
-    b2_extent = (b2->r.max.x - b2->r.min.x) / 2.0f;
+    if (ctx->num_sweep > 0) {
+        x = sum_x / ctx->num_sweep;
+        y = sum_y / ctx->num_sweep;
+        ctx->sweep_variance[0] = (sr_Scalar)(sum_xx / ctx->num_sweep - x * x);
+        ctx->sweep_variance[1] = (sr_Scalar)(sum_yy / ctx->num_sweep - y * y);
+    }
+#endif
+}
 
-    x_overlap = b1_extent + b2_extent - sr_fabsf(b2_to_b1.x);
+/* Switches the sweep axis once the bodies spread clearly more along the other one, swapping in its saved order */
 
-    b1_extent = (b1->r.max.y - b1->r.min.y) / 2.0f;
-    b2_extent = (b2->r.max.y - b2->r.min.y) / 2.0f;
+void sr_update_sweep_axis(sr_Context *ctx) {
+    sr_Scalar current, other;
 
-    y_overlap = b1_extent + b2_extent - sr_fabsf(b2_to_b1.y);
+    current = ctx->sweep_variance[ctx->sweep_direction == SR_SWEEP_X ? 0 : 1];
+    other = ctx->sweep_variance[ctx->sweep_direction == SR_SWEEP_X ? 1 : 0];
+    if (!(other > sr_mul(current, SR_SCALAR(SR_SWEEP_AUTO_RATIO)))) {
+        return;
+    }
 
-    if (x_overlap > y_overlap) {
-        if (b1->priority < b2->priority) {
-            if (b2_to_b1.y > 0.0f) {
-                sr_translate_body_direct(b1, 0.0f, y_overlap);
-                if (b2->priority == SR_PRIORITY_STATIC) {
-                    b1t->flags |= SR_COLLIDED_CEILING;
-                }
-                b1t->flags |= SR_COLLIDED_UP;
-                b2t->flags |= SR_COLLIDED_DOWN;
-            } else {
-                sr_translate_body_direct(b1, 0.0f, -y_overlap);
-                if (b2->priority == SR_PRIORITY_STATIC) {
-                    b1t->flags |= SR_COLLIDED_FLOOR;
-                }
-                b1t->flags |= SR_COLLIDED_DOWN;
-                b2t->flags |= SR_COLLIDED_UP;
-            }
+    if (ctx->num_sweep_saved == ctx->num_sweep) {
+        memcpy(ctx->sort_ids, ctx->bodies_sorted, ctx->num_sweep * sizeof(sr_Body_Id));
+        memcpy(ctx->bodies_sorted, ctx->sweep_saved, ctx->num_sweep * sizeof(sr_Body_Id));
+        memcpy(ctx->sweep_saved, ctx->sort_ids, ctx->num_sweep * sizeof(sr_Body_Id));
+    } else {
+        memcpy(ctx->sweep_saved, ctx->bodies_sorted, ctx->num_sweep * sizeof(sr_Body_Id));
+        ctx->num_sweep_saved = ctx->num_sweep;
+    }
+
+    ctx->sweep_direction = ctx->sweep_direction == SR_SWEEP_X ? SR_SWEEP_Y : SR_SWEEP_X;
+    ctx->query_dirty = 1;
+}
+
+int sr_do_hot_layers_match(const sr_Context *ctx, int i, int j) {
+    return (ctx->hot_category[i] & ctx->hot_mask[j]) && (ctx->hot_category[j] & ctx->hot_mask[i]);
+}
+
+int sr_do_hot_overlap(const sr_Context *ctx, int i, int j) {
+    return !(ctx->hot_sweep_min[i] > ctx->hot_sweep_max[j] || ctx->hot_sweep_max[i] < ctx->hot_sweep_min[j] || ctx->hot_cross_min[i] > ctx->hot_cross_max[j] || ctx->hot_cross_max[i] < ctx->hot_cross_min[j]);
+}
+
+#ifdef SR_SIMD_WIDTH
+/* Returns the first sorted position >= j the scalar sweep for i would do anything at */
+
+int sr_sweep_skip_simd(const sr_Context *ctx, int i, int j, unsigned int skip) {
+    int mask;
+#if defined(SR_AVX2)
+    SR_SIMD_SCALARS smin, smax, cmin, cmax, ismin, ismax, icmin, icmax;
+    __m256 stop, sep, enabled;
+    __m256i skip_flags, icategory, imask, zero;
+
+    ismin = SR_SIMD_SET1(ctx->hot_sweep_min[i]);
+    ismax = SR_SIMD_SET1(ctx->hot_sweep_max[i]);
+    icmin = SR_SIMD_SET1(ctx->hot_cross_min[i]);
+    icmax = SR_SIMD_SET1(ctx->hot_cross_max[i]);
+    skip_flags = _mm256_set1_epi32((int)skip);
+    icategory = _mm256_set1_epi32((int)ctx->hot_category[i]);
+    imask = _mm256_set1_epi32((int)ctx->hot_mask[i]);
+    zero = _mm256_setzero_si256();
+
+    for (; j + SR_SIMD_WIDTH <= ctx->num_sweep; j += SR_SIMD_WIDTH) {
+        smin = SR_SIMD_LOAD(ctx->hot_sweep_min + j);
+        smax = SR_SIMD_LOAD(ctx->hot_sweep_max + j);
+        cmin = SR_SIMD_LOAD(ctx->hot_cross_min + j);
+        cmax = SR_SIMD_LOAD(ctx->hot_cross_max + j);
+
+        stop = SR_SIMD_GT(smin, ismax);
+        sep = _mm256_or_ps(SR_SIMD_GT(ismin, smax), stop);
+        sep = _mm256_or_ps(sep, SR_SIMD_GT(icmin, cmax));
+        sep = _mm256_or_ps(sep, SR_SIMD_GT(cmin, icmax));
+        enabled = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(ctx->hot_flags + j)), skip_flags), zero));
+        sep = _mm256_or_ps(sep, _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(ctx->hot_mask + j)), icategory), zero)));
+        sep = _mm256_or_ps(sep, _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(ctx->hot_category + j)), imask), zero)));
+
+        mask = _mm256_movemask_ps(_mm256_or_ps(stop, _mm256_andnot_ps(sep, enabled)));
+#else
+    SR_SIMD_SCALARS smin, smax, cmin, cmax, ismin, ismax, icmin, icmax;
+    __m128 stop, sep, enabled;
+    __m128i skip_flags, icategory, imask, zero;
+
+    ismin = SR_SIMD_SET1(ctx->hot_sweep_min[i]);
+    ismax = SR_SIMD_SET1(ctx->hot_sweep_max[i]);
+    icmin = SR_SIMD_SET1(ctx->hot_cross_min[i]);
+    icmax = SR_SIMD_SET1(ctx->hot_cross_max[i]);
+    skip_flags = _mm_set1_epi32((int)skip);
+    icategory = _mm_set1_epi32((int)ctx->hot_category[i]);
+    imask = _mm_set1_epi32((int)ctx->hot_mask[i]);
+    zero = _mm_setzero_si128();
+
+    for (; j + SR_SIMD_WIDTH <= ctx->num_sweep; j += SR_SIMD_WIDTH) {
+        smin = SR_SIMD_LOAD(ctx->hot_sweep_min + j);
+        smax = SR_SIMD_LOAD(ctx->hot_sweep_max + j);
+        cmin = SR_SIMD_LOAD(ctx->hot_cross_min + j);
+        cmax = SR_SIMD_LOAD(ctx->hot_cross_max + j);
+
+        stop = SR_SIMD_GT(smin, ismax);
+        sep = _mm_or_ps(SR_SIMD_GT(ismin, smax), stop);
+        sep = _mm_or_ps(sep, SR_SIMD_GT(icmin, cmax));
+        sep = _mm_or_ps(sep, SR_SIMD_GT(cmin, icmax));
+        enabled = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i *)(ctx->hot_flags + j)), skip_flags), zero));
+        sep = _mm_or_ps(sep, _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i *)(ctx->hot_mask + j)), icategory), zero)));
+        sep = _mm_or_ps(sep, _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i *)(ctx->hot_category + j)), imask), zero)));
+
+        mask = _mm_movemask_ps(_mm_or_ps(stop, _mm_andnot_ps(sep, enabled)));
+#endif
+        if (mask != 0) {
+            while (!(mask & 1)) {
+                mask >>= 1;
+                ++j;
+            }
+            return j;
+        }
+    }
+
+    return j;
+}
+#endif
+
+int sr_do_rects_overlap(sr_Rect r1, sr_Rect r2) {
+    return !(r1.min.x > r2.max.x || r1.max.x < r2.min.x || r1.min.y > r2.max.y || r1.max.y < r2.min.y);
+}
+
+void sr_translate_body_direct(sr_Body *b, sr_Scalar xmove, sr_Scalar ymove) {
+    b->r.min.x += xmove;
+    b->r.min.y += ymove;
+    b->r.max.x += xmove;
+    b->r.max.y += ymove;
+}
+
+/* Returns the index of the body behind handle id, or -1 if id doesn't belong to a live body */
+int sr_body_index(const sr_Context *ctx, sr_Body_Id id) {
+    int slot;
+
+    if (id < 0) {
+        return -1;
+    }
+
+    slot = id & SR_ID_INDEX_MASK;
+    if (slot >= ctx->num_slots || ctx->slot_generation[slot] != (unsigned int)id >> SR_ID_INDEX_BITS) {
+        return -1;
+    }
+
+    return ctx->slot_body[slot];
+}
+
+sr_Body_Id sr_body_handle(const sr_Context *ctx, int index) {
+    int slot;
+
+    slot = ctx->body_slot[index];
+
+    return (sr_Body_Id)(ctx->slot_generation[slot] << SR_ID_INDEX_BITS | (unsigned int)slot);
+}
+
+int sr_do_layers_match(const sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
+    return (ctx->bodies[id1].category & ctx->bodies[id2].mask) && (ctx->bodies[id2].category & ctx->bodies[id1].mask);
+}
+
+/* Sleeping pairs are skipped, their bodies keep the tick flags they had */
+int sr_is_pair_asleep(const sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
+    return (ctx->bodies_tick_data[id1].flags & ctx->bodies_tick_data[id2].flags & SR_ASLEEP) != 0;
+}
+
+/* Restarts the idle count of body id, a context without the sleep array has nothing to restart */
+void sr_reset_idle(sr_Context *ctx, sr_Body_Id id) {
+    if (ctx->features & SR_FEATURE_SLEEP) {
+        ctx->sleep_idle[id] = 0;
+    }
+}
+
+/* Wakes body id if other was moved since the last tick or the resolution pushed id from old_min. Woken bodies
+ * restart at 1, so they don't count as moved themselves. */
+void sr_wake_after_resolve(sr_Context *ctx, sr_Body_Id id, sr_Body_Id other, sr_Vec2 old_min) {
+    if (ctx->bodies[id].priority == SR_PRIORITY_STATIC || ctx->sleep_idle[id] <= 1) {
+        return;
+    } else if (ctx->sleep_idle[other] == 0 || sr_abs(ctx->bodies[id].r.min.x - old_min.x) > SR_SLEEP_TOLERANCE || sr_abs(ctx->bodies[id].r.min.y - old_min.y) > SR_SLEEP_TOLERANCE) {
+        ctx->sleep_idle[id] = 1;
+    }
+}
+
+unsigned int sr_opposite_direction(unsigned int direction) {
+    switch (direction) {
+        case SR_COLLIDED_UP: return SR_COLLIDED_DOWN;
+        case SR_COLLIDED_RIGHT: return SR_COLLIDED_LEFT;
+        case SR_COLLIDED_DOWN: return SR_COLLIDED_UP;
+        default: return SR_COLLIDED_RIGHT;
+    }
+}
+
+/* Empties every slot, the table is kept empty between ticks */
+void sr_clear_contact_slots(sr_Context *ctx) {
+    int i;
+
+    for (i = 0; i < ctx->num_contact_slots; ++i) {
+        ctx->contact_slots[i].id1 = -1;
+    }
+}
+
+/* Grows the contact lists and the slot table to hold at least cap contacts */
+int sr_reserve_contacts(sr_Context *ctx, int cap) {
+    void *mem;
+    int new_cap, num_slots;
+
+    if (cap <= ctx->contacts_cap) {
+        return 0;
+    } else if (ctx->fixed_memory) {
+        return -1;
+    }
+
+    new_cap = ctx->contacts_cap > 0 ? ctx->contacts_cap : 64;
+    while (new_cap < cap) {
+        new_cap *= 2;
+    }
+    num_slots = 4 * new_cap;
+
+    /* each pointer is kept as soon as it grows so a later failure leaks nothing */
+    mem = SR_REALLOC(SR_ALLOC_CONTEXT, ctx->contacts, new_cap * sizeof(sr_Contact));
+    if (mem == NULL) {
+        return -1;
+    }
+    ctx->contacts = mem;
+    mem = SR_REALLOC(SR_ALLOC_CONTEXT, ctx->prev_contacts, new_cap * sizeof(sr_Contact));
+    if (mem == NULL) {
+        return -1;
+    }
+    ctx->prev_contacts = mem;
+    mem = SR_REALLOC(SR_ALLOC_CONTEXT, ctx->contact_begins, new_cap * sizeof(sr_Contact));
+    if (mem == NULL) {
+        return -1;
+    }
+    ctx->contact_begins = mem;
+    mem = SR_REALLOC(SR_ALLOC_CONTEXT, ctx->contact_ends, new_cap * sizeof(sr_Contact));
+    if (mem == NULL) {
+        return -1;
+    }
+    ctx->contact_ends = mem;
+    mem = SR_REALLOC(SR_ALLOC_CONTEXT, ctx->contact_slots, num_slots * sizeof(sr_Contact_Slot));
+    if (mem == NULL) {
+        return -1;
+    }
+    ctx->contact_slots = mem;
+    ctx->num_contact_slots = num_slots;
+    ctx->contacts_cap = new_cap;
+    sr_clear_contact_slots(ctx);
+
+    return 0;
+}
+
+/* Grows the child block pool to hold at least cap blocks */
+int sr_reserve_child_blocks(sr_Context *ctx, int cap) {
+    void *mem;
+    int new_cap;
+
+    if (cap <= ctx->child_blocks_cap) {
+        return 0;
+    } else if (ctx->fixed_memory) {
+        return -1;
+    }
+
+    new_cap = ctx->child_blocks_cap > 0 ? ctx->child_blocks_cap : 16;
+    while (new_cap < cap) {
+        new_cap *= 2;
+    }
+
+    mem = SR_REALLOC(SR_ALLOC_CONTEXT, ctx->child_rects, SR_CHILD_BLOCK * new_cap * sizeof(sr_Rect));
+    if (mem == NULL) {
+        return -1;
+    }
+    ctx->child_rects = mem;
+    mem = SR_REALLOC(SR_ALLOC_CONTEXT, ctx->free_child_blocks, new_cap * sizeof(int));
+    if (mem == NULL) {
+        return -1;
+    }
+    ctx->free_child_blocks = mem;
+    ctx->child_blocks_cap = new_cap;
+
+    return 0;
+}
+
+/* Contacts that don't fit and can't be grown for are dropped and counted */
+void sr_append_contact(sr_Context *ctx, const sr_Contact *contact) {
+    if (ctx->num_contacts == ctx->contacts_cap && sr_reserve_contacts(ctx, ctx->num_contacts + 1) != 0) {
+        ++ctx->num_dropped_contacts;
+        return;
+    }
+    ctx->contacts[ctx->num_contacts++] = *contact;
+}
+
+/* Records a contact between the bodies at indices id1 and id2 under their handles, smaller handle first */
+void sr_push_contact(sr_Context *ctx, const sr_Contact *contact) {
+    sr_Contact c;
+    sr_Body_Id h1, h2;
+
+    if (contact->id1 < 0) {
+        return;
+    }
+
+    c = *contact;
+    h1 = sr_body_handle(ctx, contact->id1);
+    h2 = sr_body_handle(ctx, contact->id2);
+    if (h1 < h2) {
+        c.id1 = h1;
+        c.id2 = h2;
+    } else {
+        c.id1 = h2;
+        c.id2 = h1;
+        c.direction = sr_opposite_direction(c.direction);
+    }
+    sr_append_contact(ctx, &c);
+}
+
+sr_Contact_Slot *sr_contact_slot(sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
+    SR_U32 hash;
+    sr_Contact_Slot *slot;
+
+    hash = ((SR_U32)id1 * 0x9E3779B1ul) ^ ((SR_U32)id2 * 0x85EBCA77ul);
+    hash ^= hash >> 15;
+
+    for (;;) {
+        slot = &(ctx->contact_slots[hash & (ctx->num_contact_slots - 1)]);
+        if (slot->id1 < 0 || (slot->id1 == id1 && slot->id2 == id2)) {
+            return slot;
+        }
+        ++hash;
+    }
+}
+
+/* Fills the begin and end lists by matching this tick's contacts against the previous tick's */
+void sr_update_contact_events(sr_Context *ctx) {
+    sr_Contact_Slot *slot;
+    const sr_Contact *c;
+    int i, count;
+
+    ctx->num_contact_begins = 0;
+    ctx->num_contact_ends = 0;
+
+    if (ctx->num_contacts + ctx->num_prev_contacts == 0) {
+        return;
+    }
+
+    for (i = 0; i < ctx->num_prev_contacts; ++i) {
+        c = &(ctx->prev_contacts[i]);
+        slot = sr_contact_slot(ctx, c->id1, c->id2);
+        slot->id1 = c->id1;
+        slot->id2 = c->id2;
+        slot->mark = 1;
+    }
+
+    count = 0;
+    for (i = 0; i < ctx->num_contacts; ++i) {
+        c = &(ctx->contacts[i]);
+        slot = sr_contact_slot(ctx, c->id1, c->id2);
+        if (slot->id1 < 0) {
+            slot->id1 = c->id1;
+            slot->id2 = c->id2;
+            slot->mark = 0;
+        } else if (slot->mark & 2) {
+            /* resolved again by a later iteration, the first contact is kept */
+            continue;
+        }
+        if (!(slot->mark & 1)) {
+            ctx->contact_begins[ctx->num_contact_begins++] = *c;
+        }
+        slot->mark |= 2;
+        ctx->contacts[count++] = *c;
+    }
+    ctx->num_contacts = count;
+
+    for (i = 0; i < ctx->num_prev_contacts; ++i) {
+        c = &(ctx->prev_contacts[i]);
+        if (!(sr_contact_slot(ctx, c->id1, c->id2)->mark & 2)) {
+            ctx->contact_ends[ctx->num_contact_ends++] = *c;
+        }
+    }
+
+    /* empties the used slots newest first, so every slot still finds the ones it was probed past */
+    for (i = ctx->num_contacts - 1; i >= 0; --i) {
+        c = &(ctx->contacts[i]);
+        slot = sr_contact_slot(ctx, c->id1, c->id2);
+        if (!(slot->mark & 1)) {
+            slot->id1 = -1;
+        }
+    }
+    for (i = ctx->num_prev_contacts - 1; i >= 0; --i) {
+        c = &(ctx->prev_contacts[i]);
+        sr_contact_slot(ctx, c->id1, c->id2)->id1 = -1;
+    }
+}
+
+/* Pushes two overlapping bodies, at most one of them static, apart and writes their tick flags to b1t and b2t.
+ * If contact isn't NULL it gets the direction flag b1 got and the penetration. */
+void sr_separate_bodies(sr_Body *b1, sr_Body *b2, sr_Body_Tick_Data *b1t, sr_Body_Tick_Data *b2t, sr_Contact *contact) {
+    sr_Vec2 b2_to_b1;
+    sr_Scalar b1_extent, b2_extent, x_overlap, y_overlap;
+
+    b1t->flags |= SR_COLLIDED;
+    b2t->flags |= SR_COLLIDED;
+
+    b1t->custom_flags |= b2->custom_flags;
+    b2t->custom_flags |= b1->custom_flags;
+
+    b2_to_b1.x = sr_half(b1->r.min.x + b1->r.max.x) - sr_half(b2->r.min.x + b2->r.max.x);
+    b2_to_b1.y = sr_half(b1->r.min.y + b1->r.max.y) - sr_half(b2->r.min.y + b2->r.max.y);
+
+    b1_extent = sr_half(b1->r.max.x - b1->r.min.x);
+    b2_extent = sr_half(b2->r.max.x - b2->r.min.x);
+
+    x_overlap = b1_extent + b2_extent - sr_abs(b2_to_b1.x);
+
+    b1_extent = sr_half(b1->r.max.y - b1->r.min.y);
+    b2_extent = sr_half(b2->r.max.y - b2->r.min.y);
+
+    y_overlap = b1_extent + b2_extent - sr_abs(b2_to_b1.y);
+
+    if (contact != NULL) {
+        /* same tie breaks as below, where a higher priority b1 pushes b2 away on a zero offset */
+        if (x_overlap > y_overlap) {
+            contact->penetration = y_overlap;
+            contact->direction = (b1->priority > b2->priority ? b2_to_b1.y >= 0 : b2_to_b1.y > 0) ? SR_COLLIDED_UP : SR_COLLIDED_DOWN;
+        } else {
+            contact->penetration = x_overlap;
+            contact->direction = (b1->priority > b2->priority ? b2_to_b1.x >= 0 : b2_to_b1.x > 0) ? SR_COLLIDED_LEFT : SR_COLLIDED_RIGHT;
+        }
+    }
+
+    if (x_overlap > y_overlap) {
+        if (b1->priority < b2->priority) {
+            if (b2_to_b1.y > 0) {
+                sr_translate_body_direct(b1, 0, y_overlap);
+                if (b2->priority == SR_PRIORITY_STATIC) {
+                    b1t->flags |= SR_COLLIDED_CEILING;
+                }
+                b1t->flags |= SR_COLLIDED_UP;
+                b2t->flags |= SR_COLLIDED_DOWN;
+            } else {
+                sr_translate_body_direct(b1, 0, -y_overlap);
+                if (b2->priority == SR_PRIORITY_STATIC) {
+                    b1t->flags |= SR_COLLIDED_FLOOR;
+                }
+                b1t->flags |= SR_COLLIDED_DOWN;
+                b2t->flags |= SR_COLLIDED_UP;
+            }
         } else if (b1->priority == b2->priority) {
-            if (b2_to_b1.y > 0.0f) {
-                sr_translate_body_direct(b1, 0.0f, y_overlap / 2.0f);
-                sr_translate_body_direct(b2, 0.0f, -y_overlap / 2.0f);
+            if (b2_to_b1.y > 0) {
+                sr_translate_body_direct(b1, 0, sr_half(y_overlap));
+                sr_translate_body_direct(b2, 0, -sr_half(y_overlap));
                 b1t->flags |= SR_COLLIDED_UP;
                 b2t->flags |= SR_COLLIDED_DOWN;
             } else {
-                sr_translate_body_direct(b1, 0.0f, -y_overlap / 2.0f);
-                sr_translate_body_direct(b2, 0.0f, y_overlap / 2.0f);
+                sr_translate_body_direct(b1, 0, -sr_half(y_overlap));
+                sr_translate_body_direct(b2, 0, sr_half(y_overlap));
                 b1t->flags |= SR_COLLIDED_DOWN;
                 b2t->flags |= SR_COLLIDED_UP;
             }
         } else {
-            if (b2_to_b1.y < 0.0f) {
-                sr_translate_body_direct(b2, 0.0f, y_overlap);
+            if (b2_to_b1.y < 0) {
+                sr_translate_body_direct(b2, 0, y_overlap);
                 if (b1->priority == SR_PRIORITY_STATIC) {
                     b2t->flags |= SR_COLLIDED_CEILING;
                 }
                 b1t->flags |= SR_COLLIDED_DOWN;
                 b2t->flags |= SR_COLLIDED_UP;
             } else {
-                sr_translate_body_direct(b2, 0.0f, -y_overlap);
+                sr_translate_body_direct(b2, 0, -y_overlap);
                 if (b1->priority == SR_PRIORITY_STATIC) {
                     b2t->flags |= SR_COLLIDED_FLOOR;
                 }
@@ -312,15 +1489,15 @@ void sr_resolve_bodies(sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
         }
     } else {
         if (b1->priority < b2->priority) {
-            if (b2_to_b1.x > 0.0f) {
-                sr_translate_body_direct(b1, x_overlap, 0.0f);
+            if (b2_to_b1.x > 0) {
+                sr_translate_body_direct(b1, x_overlap, 0);
                 if (b2->priority == SR_PRIORITY_STATIC) {
                     b1t->flags |= SR_COLLIDED_LEFT_WALL;
                 }
                 b1t->flags |= SR_COLLIDED_LEFT;
                 b2t->flags |= SR_COLLIDED_RIGHT;
             } else {
-                sr_translate_body_direct(b1, -x_overlap, 0.0f);
+                sr_translate_body_direct(b1, -x_overlap, 0);
                 if (b2->priority == SR_PRIORITY_STATIC) {
                     b1t->flags |= SR_COLLIDED_RIGHT_WALL;
                 }
@@ -328,27 +1505,27 @@ void sr_resolve_bodies(sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
                 b2t->flags |= SR_COLLIDED_LEFT;
             }
         } else if (b1->priority == b2->priority) {
-            if (b2_to_b1.x > 0.0f) {
-                sr_translate_body_direct(b1, x_overlap / 2.0f, 0.0f);
-                sr_translate_body_direct(b2, -x_overlap / 2.0f, 0.0f);
+            if (b2_to_b1.x > 0) {
+                sr_translate_body_direct(b1, sr_half(x_overlap), 0);
+                sr_translate_body_direct(b2, -sr_half(x_overlap), 0);
                 b1t->flags |= SR_COLLIDED_LEFT;
                 b2t->flags |= SR_COLLIDED_RIGHT;
             } else {
-                sr_translate_body_direct(b1, -x_overlap / 2.0f, 0.0f);
-                sr_translate_body_direct(b2, x_overlap / 2.0f, 0.0f);
+                sr_translate_body_direct(b1, -sr_half(x_overlap), 0);
+                sr_translate_body_direct(b2, sr_half(x_overlap), 0);
                 b1t->flags |= SR_COLLIDED_RIGHT;
                 b2t->flags |= SR_COLLIDED_LEFT;
             }
         } else {
-            if (b2_to_b1.x < 0.0f) {
-                sr_translate_body_direct(b2, x_overlap, 0.0f);
+            if (b2_to_b1.x < 0) {
+                sr_translate_body_direct(b2, x_overlap, 0);
                 if (b1->priority == SR_PRIORITY_STATIC) {
                     b2t->flags |= SR_COLLIDED_LEFT_WALL;
                 }
                 b1t->flags |= SR_COLLIDED_RIGHT;
                 b2t->flags |= SR_COLLIDED_LEFT;
             } else {
-                sr_translate_body_direct(b2, -x_overlap, 0.0f);
+                sr_translate_body_direct(b2, -x_overlap, 0);
                 if (b1->priority == SR_PRIORITY_STATIC) {
                     b2t->flags |= SR_COLLIDED_RIGHT_WALL;
                 }
@@ -359,447 +1536,5099 @@ void sr_resolve_bodies(sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
     }
 }
 
-int sr_context_init(sr_Context *ctx, int expected_num_bodies, sr_Sweep_Direction sdir) {
-    int bodies_to_alloc;
-    SR_ASSERT(sizeof(float) == 4 && sizeof(unsigned int) == 4 && "custom fabsf relies on float and unsigned int being 32 bit, which does not appear to be true");
-    SR_ASSERT(sr_fabsf(-1.0f) == 1.0f && "custom fabsf does not appear to be working");
-    SR_ASSERT(ctx != NULL && "cannot initialize null pointer");
-
-    if (expected_num_bodies == 0) {
-        bodies_to_alloc = 1;
+/* Writes the rect of child i of body b, a body without children is a single child covering its rect */
+void sr_child_rect(sr_Rect *rect_out, const sr_Body *b, const sr_Rect *children, int num_children, int i) {
+    if (num_children == 0) {
+        *rect_out = b->r;
     } else {
-        bodies_to_alloc = expected_num_bodies;
+        rect_out->min.x = b->r.min.x + children[i].min.x;
+        rect_out->min.y = b->r.min.y + children[i].min.y;
+        rect_out->max.x = b->r.min.x + children[i].max.x;
+        rect_out->max.y = b->r.min.y + children[i].max.y;
     }
+}
 
-    ctx->bodies = SR_REALLOC(SR_ALLOC_CONTEXT, NULL, sizeof(sr_Body) * bodies_to_alloc + sizeof(sr_Body_Id) * bodies_to_alloc + sizeof(sr_Body_Tick_Data) * bodies_to_alloc);
-    if (ctx->bodies == NULL) {
-        return -1;
-    } else {
-        ctx->bodies_sorted = (sr_Body_Id *)(ctx->bodies + bodies_to_alloc);
-        ctx->bodies_tick_data = (sr_Body_Tick_Data *)(ctx->bodies_sorted + bodies_to_alloc);
-        ctx->num_bodies = 0;
-        ctx->bodies_cap = bodies_to_alloc;
-        ctx->sweep_direction = sdir;
+/* sr_separate_bodies() for the deepest overlapping pair of children, returns 0 if no children overlap */
+
+int sr_separate_children(sr_Body *b1, sr_Body *b2, const sr_Rect *children1, int n1, const sr_Rect *children2, int n2, sr_Body_Tick_Data *b1t, sr_Body_Tick_Data *b2t, sr_Contact *contact) {
+    sr_Body c1, c2;
+    sr_Vec2 c1_min, c2_min;
+    sr_Scalar x_overlap, y_overlap, depth, best_depth;
+    int i, k, best_i, best_k;
+
+    c1 = *b1;
+    c2 = *b2;
+    best_i = -1;
+    best_k = -1;
+    best_depth = 0;
+    for (i = 0; i < (n1 > 0 ? n1 : 1); ++i) {
+        for (k = 0; k < (n2 > 0 ? n2 : 1); ++k) {
+            sr_child_rect(&(c1.r), b1, children1, n1, i);
+            sr_child_rect(&(c2.r), b2, children2, n2, k);
+            if (!sr_do_rects_overlap(c1.r, c2.r)) {
+                continue;
+            }
+
+            x_overlap = (c1.r.max.x < c2.r.max.x ? c1.r.max.x : c2.r.max.x) - (c1.r.min.x > c2.r.min.x ? c1.r.min.x : c2.r.min.x);
+            y_overlap = (c1.r.max.y < c2.r.max.y ? c1.r.max.y : c2.r.max.y) - (c1.r.min.y > c2.r.min.y ? c1.r.min.y : c2.r.min.y);
+            depth = x_overlap < y_overlap ? x_overlap : y_overlap;
+            if (best_i == -1 || depth > best_depth) {
+                best_i = i;
+                best_k = k;
+                best_depth = depth;
+            }
+        }
+    }
 
+    if (best_i == -1) {
         return 0;
     }
+
+    sr_child_rect(&(c1.r), b1, children1, n1, best_i);
+    sr_child_rect(&(c2.r), b2, children2, n2, best_k);
+    c1_min = c1.r.min;
+    c2_min = c2.r.min;
+    sr_separate_bodies(&c1, &c2, b1t, b2t, contact);
+    sr_translate_body_direct(b1, c1.r.min.x - c1_min.x, c1.r.min.y - c1_min.y);
+    sr_translate_body_direct(b2, c2.r.min.x - c2_min.x, c2.r.min.y - c2_min.y);
+
+    for (i = 0; i < (n1 > 0 ? n1 : 1); ++i) {
+        for (k = 0; k < (n2 > 0 ? n2 : 1); ++k) {
+            sr_child_rect(&(c1.r), b1, children1, n1, i);
+            sr_child_rect(&(c2.r), b2, children2, n2, k);
+            if (sr_do_rects_overlap(c1.r, c2.r)) {
+                b1t->children |= n1 > 0 ? 1u << i : 0u;
+                b2t->children |= n2 > 0 ? 1u << k : 0u;
+            }
+        }
+    }
+
+    return 1;
 }
 
-void sr_context_deinit(sr_Context *ctx) {
-    SR_FREE(SR_ALLOC_CONTEXT, ctx->bodies);
-    ctx->bodies = NULL;
-    ctx->bodies_sorted = NULL;
-    ctx->bodies_tick_data = NULL;
-    ctx->num_bodies = 0;
-    ctx->bodies_cap = 0;
-    ctx->sweep_direction = 0;
+/* Returns the child rects of the body at index id, NULL if it has none */
+const sr_Rect *sr_body_children(const sr_Context *ctx, int id) {
+    return ctx->child_blocks[id] == -1 ? NULL : &(ctx->child_rects[ctx->child_blocks[id] * SR_CHILD_BLOCK + 1]);
 }
 
-void sr_context_clear(sr_Context *ctx) {
-    ctx->num_bodies = 0;
+/* Resolves two overlapping bodies, writing their tick flags to b1t and b2t and, if contact isn't NULL, their contact.
+ * contact->id1 is set to -1 if the bodies aren't resolved. */
+void sr_resolve_bodies_into(sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2, sr_Body_Tick_Data *b1t, sr_Body_Tick_Data *b2t, sr_Contact *contact) {
+    sr_Vec2 b1_min, b2_min;
+
+    b1_min = ctx->bodies[id1].r.min;
+    b2_min = ctx->bodies[id2].r.min;
+
+    if (ctx->bodies[id1].priority == SR_PRIORITY_STATIC && ctx->bodies[id2].priority == SR_PRIORITY_STATIC) {
+        if (contact != NULL) {
+            contact->id1 = -1;
+        }
+        return;
+    }
+
+    if (ctx->child_counts[id1] == 0 && ctx->child_counts[id2] == 0) {
+        sr_separate_bodies(&(ctx->bodies[id1]), &(ctx->bodies[id2]), b1t, b2t, contact);
+    } else if (sr_separate_children(&(ctx->bodies[id1]), &(ctx->bodies[id2]), sr_body_children(ctx, id1), ctx->child_counts[id1],
+                                    sr_body_children(ctx, id2), ctx->child_counts[id2], b1t, b2t, contact) == 0) {
+        /* only the bounding boxes overlapped */
+        if (contact != NULL) {
+            contact->id1 = -1;
+        }
+        return;
+    }
+
+    if (contact != NULL) {
+        if (id1 < id2) {
+            contact->id1 = id1;
+            contact->id2 = id2;
+        } else {
+            contact->id1 = id2;
+            contact->id2 = id1;
+            contact->direction = sr_opposite_direction(contact->direction);
+        }
+    }
+
+    if (ctx->options & SR_OPTION_SLEEP) {
+        sr_wake_after_resolve(ctx, id1, id2, b1_min);
+        sr_wake_after_resolve(ctx, id2, id1, b2_min);
+    }
 }
 
-sr_Body_Id sr_new_body(sr_Context *ctx, float xpos, float ypos, float xdim, float ydim, sr_Attach_Location loc, int priority, unsigned int flags, unsigned int custom_flags) {
-    sr_Body b;
+sr_Rect sr_rect_union(sr_Rect r1, sr_Rect r2) {
+    sr_Rect r;
 
-    b.priority = priority;
-    b.flags = flags;
-    b.custom_flags = custom_flags;
+    r.min.x = r1.min.x < r2.min.x ? r1.min.x : r2.min.x;
+    r.min.y = r1.min.y < r2.min.y ? r1.min.y : r2.min.y;
+    r.max.x = r1.max.x > r2.max.x ? r1.max.x : r2.max.x;
+    r.max.y = r1.max.y > r2.max.y ? r1.max.y : r2.max.y;
 
-    switch (loc) {
-    case SR_CENTER:
-        b.offset.x = xdim / 2.0f;
-        b.offset.y = ydim / 2.0f;
-        break;
-    case SR_TOP_CENTER:
-        b.offset.x = xdim / 2.0f;
-        b.offset.y = 0.0f;
-        break;
-    case SR_TOP_RIGHT:
-        b.offset.x = xdim;
-        b.offset.y = 0.0f;
-        break;
-    case SR_CENTER_RIGHT:
-        b.offset.x = xdim;
-        b.offset.y = ydim / 2.0f;
-        break;
-    case SR_BOTTOM_RIGHT:
-        b.offset.x = xdim;
-        b.offset.y = ydim;
-        break;
-    case SR_BOTTOM_CENTER:
-        b.offset.x = xdim / 2.0f;
-        b.offset.y = ydim;
-        break;
-    case SR_BOTTOM_LEFT:
-        b.offset.x = 0.0f;
-        b.offset.y = ydim;
-        break;
-    case SR_CENTER_LEFT:
-        b.offset.x = 0.0f;
-        b.offset.y = ydim / 2.0f;
-        break;
-    case SR_TOP_LEFT:
-        b.offset.x = 0.0f;
-        b.offset.y = 0.0f;
-        break;
+    return r;
+}
+
+sr_Scalar sr_rect_perimeter(sr_Rect r) {
+#ifdef SR_FIXED
+    /* scaled down by 8, so the tree costs of rects in range can't overflow, the costs are only compared */
+    return sr_half(sr_half(r.max.x - r.min.x) + sr_half(r.max.y - r.min.y));
+#else
+    return 2 * ((r.max.x - r.min.x) + (r.max.y - r.min.y));
+#endif
+}
+
+int sr_does_rect_contain(sr_Rect outer, sr_Rect inner) {
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.max.x >= inner.max.x && outer.max.y >= inner.max.y;
+}
+
+/* Pushes the nodes [first, last) onto the free list */
+void sr_tree_free_nodes(sr_Context *ctx, int first, int last) {
+    int i;
+
+    for (i = last - 1; i >= first; --i) {
+        ctx->tree_nodes[i].parent = ctx->tree_free;
+        ctx->tree_nodes[i].height = -1;
+        ctx->tree_free = i;
+    }
+}
+
+int sr_tree_alloc_node(sr_Context *ctx) {
+    int node;
+
+    /* a tree with n leaves has 2n - 1 nodes, so the pool cannot run dry */
+    SR_ASSERT(ctx->tree_free != -1 && "tree node pool exhausted");
+
+    node = ctx->tree_free;
+    ctx->tree_free = ctx->tree_nodes[node].parent;
+    ctx->tree_nodes[node].parent = -1;
+    ctx->tree_nodes[node].child1 = -1;
+    ctx->tree_nodes[node].child2 = -1;
+    ctx->tree_nodes[node].height = 0;
+    ctx->tree_nodes[node].body = -1;
+
+    return node;
+}
+
+void sr_tree_release_node(sr_Context *ctx, int node) {
+    ctx->tree_nodes[node].parent = ctx->tree_free;
+    ctx->tree_nodes[node].height = -1;
+    ctx->tree_free = node;
+}
+
+void sr_tree_fix_node(sr_Context *ctx, int node) {
+    sr_Tree_Node *n, *c1, *c2;
+
+    n = &(ctx->tree_nodes[node]);
+    c1 = &(ctx->tree_nodes[n->child1]);
+    c2 = &(ctx->tree_nodes[n->child2]);
+
+    n->aabb = sr_rect_union(c1->aabb, c2->aabb);
+    n->height = 1 + (c1->height > c2->height ? c1->height : c2->height);
+}
+
+void sr_tree_replace_child(sr_Context *ctx, int tree, int parent, int old_child, int new_child) {
+    if (parent == -1) {
+        ctx->tree_roots[tree] = new_child;
+    } else if (ctx->tree_nodes[parent].child1 == old_child) {
+        ctx->tree_nodes[parent].child1 = new_child;
+    } else {
+        ctx->tree_nodes[parent].child2 = new_child;
+    }
+}
+
+/* Rotates the taller grandchild of a up if the subtrees of a differ in height by more than one, returns the new subtree root */
+int sr_tree_balance(sr_Context *ctx, int tree, int a) {
+    sr_Tree_Node *nodes;
+    int b, c, up, low, keep, other, balance;
+
+    nodes = ctx->tree_nodes;
+
+    if (nodes[a].child1 == -1 || nodes[a].height < 2) {
+        return a;
+    }
+
+    b = nodes[a].child1;
+    c = nodes[a].child2;
+    balance = nodes[c].height - nodes[b].height;
+
+    if (balance > 1) {
+        up = c;
+        low = b;
+    } else if (balance < -1) {
+        up = b;
+        low = c;
+    } else {
+        return a;
+    }
+
+    /* up takes the place of a, a keeps low and the shorter child of up, up keeps a and its taller child */
+    if (nodes[nodes[up].child1].height > nodes[nodes[up].child2].height) {
+        keep = nodes[up].child1;
+        other = nodes[up].child2;
+    } else {
+        keep = nodes[up].child2;
+        other = nodes[up].child1;
+    }
+
+    nodes[up].parent = nodes[a].parent;
+    sr_tree_replace_child(ctx, tree, nodes[a].parent, a, up);
+    nodes[up].child1 = a;
+    nodes[up].child2 = keep;
+    nodes[a].parent = up;
+
+    nodes[a].child1 = low;
+    nodes[a].child2 = other;
+    nodes[other].parent = a;
+
+    sr_tree_fix_node(ctx, a);
+    sr_tree_fix_node(ctx, up);
+
+    return up;
+}
+
+void sr_tree_refit(sr_Context *ctx, int tree, int node) {
+    while (node != -1) {
+        node = sr_tree_balance(ctx, tree, node);
+        sr_tree_fix_node(ctx, node);
+        node = ctx->tree_nodes[node].parent;
+    }
+}
+
+/* Inserts a leaf next to the sibling that grows the total perimeter of the tree the least */
+void sr_tree_insert_leaf(sr_Context *ctx, int tree, int leaf) {
+    sr_Tree_Node *nodes;
+    sr_Rect leaf_aabb;
+    sr_Scalar cost, inheritance, child_cost[2];
+    int node, k, child, old_parent, new_parent;
+
+    nodes = ctx->tree_nodes;
+
+    nodes[leaf].tree = tree;
+
+    if (ctx->tree_roots[tree] == -1) {
+        ctx->tree_roots[tree] = leaf;
+        nodes[leaf].parent = -1;
+        return;
+    }
+
+    leaf_aabb = nodes[leaf].aabb;
+    node = ctx->tree_roots[tree];
+
+    while (nodes[node].child1 != -1) {
+        cost = 2 * sr_rect_perimeter(sr_rect_union(nodes[node].aabb, leaf_aabb));
+        inheritance = cost - 2 * sr_rect_perimeter(nodes[node].aabb);
+
+        for (k = 0; k < 2; ++k) {
+            child = k == 0 ? nodes[node].child1 : nodes[node].child2;
+            child_cost[k] = sr_rect_perimeter(sr_rect_union(nodes[child].aabb, leaf_aabb)) + inheritance;
+            if (nodes[child].child1 != -1) {
+                child_cost[k] -= sr_rect_perimeter(nodes[child].aabb);
+            }
+        }
+
+        if (cost < child_cost[0] && cost < child_cost[1]) {
+            break;
+        }
+
+        node = child_cost[0] < child_cost[1] ? nodes[node].child1 : nodes[node].child2;
+    }
+
+    old_parent = nodes[node].parent;
+    new_parent = sr_tree_alloc_node(ctx);
+    nodes[new_parent].parent = old_parent;
+    nodes[new_parent].child1 = node;
+    nodes[new_parent].child2 = leaf;
+    nodes[node].parent = new_parent;
+    nodes[leaf].parent = new_parent;
+    sr_tree_replace_child(ctx, tree, old_parent, node, new_parent);
+
+    sr_tree_refit(ctx, tree, new_parent);
+}
+
+void sr_tree_remove_leaf(sr_Context *ctx, int leaf) {
+    sr_Tree_Node *nodes;
+    int tree, parent, grand_parent, sibling;
+
+    nodes = ctx->tree_nodes;
+    tree = nodes[leaf].tree;
+
+    if (leaf == ctx->tree_roots[tree]) {
+        ctx->tree_roots[tree] = -1;
+        return;
+    }
+
+    parent = nodes[leaf].parent;
+    grand_parent = nodes[parent].parent;
+    sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    sr_tree_replace_child(ctx, tree, grand_parent, parent, sibling);
+    nodes[sibling].parent = grand_parent;
+    sr_tree_release_node(ctx, parent);
+
+    sr_tree_refit(ctx, tree, grand_parent);
+}
+
+/* With SR_OPTION_STATIC_INDEX the static bodies are left out of the broadphase and tested against the static index instead */
+int sr_is_body_in_broadphase(const sr_Context *ctx, const sr_Body *b) {
+    if (b->flags & (SR_DISABLED | SR_NO_COLLISION)) {
+        return 0;
+    } else if (b->priority == SR_PRIORITY_STATIC && ctx->options & SR_OPTION_STATIC_INDEX) {
+        return 0;
+    } else {
+        return 1;
+    }
+}
+
+/* Has sr_tree_resolve check the leaf of body id, or of every body if id is -1 */
+void sr_tree_mark_moved(sr_Context *ctx, sr_Body_Id id) {
+    if (!(ctx->features & SR_FEATURE_TREE)) {
+        return;
+    } else if (id == -1) {
+        memset(ctx->tree_moved, 0xFF, (ctx->bodies_cap + 31) / 32 * sizeof(SR_U32));
+    } else {
+        ctx->tree_moved[id / 32] |= (SR_U32)1 << (id % 32);
+    }
+}
+
+/* Reinserts the leaf of body id once it leaves its fat AABB, into the static tree for static bodies */
+void sr_tree_update_body(sr_Context *ctx, sr_Body_Id id) {
+    const sr_Body *b;
+    sr_Vec2 d;
+    int leaf, tree;
+
+    b = &(ctx->bodies[id]);
+    leaf = ctx->tree_proxy[id];
+    tree = b->flags & SR_NO_COLLISION ? SR_TREE_QUERY : b->priority == SR_PRIORITY_STATIC ? SR_TREE_STATIC : SR_TREE_DYNAMIC;
+
+    if (b->priority == SR_PRIORITY_STATIC && ctx->options & SR_OPTION_STATIC_INDEX) {
+        /* owned by the static index */
+        return;
+    } else if (b->flags & SR_DISABLED) {
+        if (leaf != -1) {
+            sr_tree_remove_leaf(ctx, leaf);
+            sr_tree_release_node(ctx, leaf);
+            ctx->tree_proxy[id] = -1;
+        }
+        return;
+    }
+
+    d.x = b->r.min.x - ctx->prev_min[id].x;
+    d.y = b->r.min.y - ctx->prev_min[id].y;
+    if (d.x != 0 || d.y != 0) {
+        sr_tree_mark_moved(ctx, id);
+    }
+
+    if (leaf != -1) {
+        if (ctx->tree_nodes[leaf].tree == tree && sr_does_rect_contain(ctx->tree_nodes[leaf].aabb, b->r)) {
+            return;
+        }
+        sr_tree_remove_leaf(ctx, leaf);
+    } else {
+        leaf = sr_tree_alloc_node(ctx);
+        ctx->tree_nodes[leaf].body = id;
+        ctx->tree_proxy[id] = leaf;
+    }
+
+    ctx->tree_nodes[leaf].aabb.min.x = b->r.min.x - SR_TREE_MARGIN + (d.x < 0 ? d.x : 0);
+    ctx->tree_nodes[leaf].aabb.min.y = b->r.min.y - SR_TREE_MARGIN + (d.y < 0 ? d.y : 0);
+    ctx->tree_nodes[leaf].aabb.max.x = b->r.max.x + SR_TREE_MARGIN + (d.x > 0 ? d.x : 0);
+    ctx->tree_nodes[leaf].aabb.max.y = b->r.max.y + SR_TREE_MARGIN + (d.y > 0 ? d.y : 0);
+    sr_tree_insert_leaf(ctx, tree, leaf);
+}
+
+/* Updates the leaves of the bodies moved since they were last checked, in index order */
+void sr_tree_update_moved(sr_Context *ctx) {
+    SR_U32 bits;
+    int w, i;
+
+    for (w = 0; w < (ctx->num_bodies + 31) / 32; ++w) {
+        bits = ctx->tree_moved[w];
+        ctx->tree_moved[w] = 0;
+        for (i = w * 32; bits != 0; bits >>= 1, ++i) {
+            if (bits & 1u && i < ctx->num_bodies) {
+                sr_tree_update_body(ctx, i);
+            }
+        }
+    }
+}
+
+/* Writes up to max_out bodies of the tree whose fat AABB overlaps r to ids_out and returns how many there are */
+int sr_tree_query_rect(const sr_Context *ctx, int tree, sr_Rect r, sr_Body_Id *ids_out, int max_out) {
+    const sr_Tree_Node *n;
+    int stack[SR_TREE_STACK_SIZE];
+    int top, count;
+
+    if (ctx->tree_roots[tree] == -1) {
+        return 0;
+    }
+
+    count = 0;
+    top = 0;
+    stack[top++] = ctx->tree_roots[tree];
+
+    while (top > 0) {
+        n = &(ctx->tree_nodes[stack[--top]]);
+
+        if (!sr_do_rects_overlap(n->aabb, r)) {
+            continue;
+        } else if (n->child1 == -1) {
+            if (count < max_out) {
+                ids_out[count] = n->body;
+            }
+            ++count;
+        } else {
+            SR_ASSERT(top + 2 <= SR_TREE_STACK_SIZE && "tree too deep for SR_TREE_STACK_SIZE");
+            stack[top++] = n->child2;
+            stack[top++] = n->child1;
+        }
+    }
+
+    return count;
+}
+
+void sr_tree_release_subtree(sr_Context *ctx, int root) {
+    int stack[SR_TREE_STACK_SIZE];
+    int top, node;
+
+    if (root == -1) {
+        return;
+    }
+
+    top = 0;
+    stack[top++] = root;
+
+    while (top > 0) {
+        node = stack[--top];
+        if (ctx->tree_nodes[node].child1 != -1) {
+            SR_ASSERT(top + 2 <= SR_TREE_STACK_SIZE && "tree too deep for SR_TREE_STACK_SIZE");
+            stack[top++] = ctx->tree_nodes[node].child1;
+            stack[top++] = ctx->tree_nodes[node].child2;
+        }
+        sr_tree_release_node(ctx, node);
+    }
+}
+
+sr_Scalar sr_body_center_key(const sr_Context *ctx, sr_Body_Id id, int axis) {
+    if (axis == 0) {
+        return ctx->bodies[id].r.min.x + ctx->bodies[id].r.max.x;
+    } else {
+        return ctx->bodies[id].r.min.y + ctx->bodies[id].r.max.y;
+    }
+}
+
+/* Reorders ids so that ids[nth] has the center it would have if sorted, with no larger centers before it */
+void sr_select_nth(const sr_Context *ctx, sr_Body_Id *ids, int count, int nth, int axis) {
+    sr_Body_Id temp;
+    sr_Scalar pivot;
+    int lo, hi, i, j;
+
+    lo = 0;
+    hi = count - 1;
+
+    while (lo < hi) {
+        pivot = sr_body_center_key(ctx, ids[lo + (hi - lo) / 2], axis);
+        i = lo;
+        j = hi;
+
+        while (i <= j) {
+            while (sr_body_center_key(ctx, ids[i], axis) < pivot) {
+                ++i;
+            }
+            while (sr_body_center_key(ctx, ids[j], axis) > pivot) {
+                --j;
+            }
+            if (i <= j) {
+                temp = ids[i];
+                ids[i] = ids[j];
+                ids[j] = temp;
+                ++i;
+                --j;
+            }
+        }
+
+        if (nth <= j) {
+            hi = j;
+        } else if (nth >= i) {
+            lo = i;
+        } else {
+            break;
+        }
+    }
+}
+
+/* Top down build of a subtree over ids, splitting at the median center along the longer axis, returns the subtree root */
+int sr_tree_build(sr_Context *ctx, int tree, sr_Body_Id *ids, int count) {
+    sr_Scalar min_x, max_x, min_y, max_y, key;
+    int i, node, left, right;
+
+    if (count == 1) {
+        node = sr_tree_alloc_node(ctx);
+        ctx->tree_nodes[node].aabb = ctx->bodies[ids[0]].r;
+        ctx->tree_nodes[node].body = ids[0];
+        ctx->tree_nodes[node].tree = tree;
+        ctx->tree_proxy[ids[0]] = node;
+
+        return node;
+    }
+
+    min_x = max_x = sr_body_center_key(ctx, ids[0], 0);
+    min_y = max_y = sr_body_center_key(ctx, ids[0], 1);
+    for (i = 1; i < count; ++i) {
+        key = sr_body_center_key(ctx, ids[i], 0);
+        min_x = key < min_x ? key : min_x;
+        max_x = key > max_x ? key : max_x;
+        key = sr_body_center_key(ctx, ids[i], 1);
+        min_y = key < min_y ? key : min_y;
+        max_y = key > max_y ? key : max_y;
+    }
+
+    sr_select_nth(ctx, ids, count, count / 2, max_x - min_x >= max_y - min_y ? 0 : 1);
+
+    left = sr_tree_build(ctx, tree, ids, count / 2);
+    right = sr_tree_build(ctx, tree, ids + count / 2, count - count / 2);
+
+    node = sr_tree_alloc_node(ctx);
+    ctx->tree_nodes[node].child1 = left;
+    ctx->tree_nodes[node].child2 = right;
+    ctx->tree_nodes[node].tree = tree;
+    ctx->tree_nodes[left].parent = node;
+    ctx->tree_nodes[right].parent = node;
+    sr_tree_fix_node(ctx, node);
+
+    return node;
+}
+
+/* Rebuilds the tree over the static bodies and moves them behind the swept ones in bodies_sorted */
+void sr_rebuild_static_index(sr_Context *ctx) {
+    int i, count, num_sorted;
+
+    sr_tree_release_subtree(ctx, ctx->tree_roots[SR_TREE_STATIC]);
+    ctx->tree_roots[SR_TREE_STATIC] = -1;
+
+    num_sorted = ctx->num_bodies - ctx->num_free_dropped;
+    count = 0;
+    for (i = 0; i < num_sorted; ++i) {
+        if (ctx->bodies[ctx->bodies_sorted[i]].priority != SR_PRIORITY_STATIC) {
+            ctx->sort_ids[count++] = ctx->bodies_sorted[i];
+        }
+    }
+    ctx->num_sweep = count;
+    for (i = 0; i < num_sorted; ++i) {
+        if (ctx->bodies[ctx->bodies_sorted[i]].priority == SR_PRIORITY_STATIC) {
+            ctx->sort_ids[count++] = ctx->bodies_sorted[i];
+        }
+    }
+    memcpy(ctx->bodies_sorted, ctx->sort_ids, num_sorted * sizeof(sr_Body_Id));
+
+    if (ctx->num_sweep < num_sorted) {
+        ctx->tree_roots[SR_TREE_STATIC] = sr_tree_build(ctx, SR_TREE_STATIC, ctx->bodies_sorted + ctx->num_sweep, num_sorted - ctx->num_sweep);
+    }
+
+    ctx->static_dirty = 0;
+}
+
+/* Returns the array at offset *at of mem, or NULL if mem is NULL or bytes 0, and moves *at on to the next cache line */
+void *sr_carve_array(char *mem, size_t *at, size_t bytes) {
+    void *array;
+
+    array = mem != NULL && bytes > 0 ? mem + *at : NULL;
+    *at += (bytes + SR_CACHE_LINE - 1) / SR_CACHE_LINE * SR_CACHE_LINE;
+
+    return array;
+}
+
+/* The optional per body arrays a context needs for the broadphase sdir and the options */
+unsigned int sr_context_features(sr_Sweep_Direction sdir, unsigned int options) {
+    unsigned int features;
+
+    features = 0;
+    if (sdir == SR_BROADPHASE_GRID) {
+        features |= SR_FEATURE_GRID;
+    }
+    if (sdir == SR_BROADPHASE_TREE || options & SR_OPTION_STATIC_INDEX) {
+        features |= SR_FEATURE_TREE;
+    }
+    if (options & SR_OPTION_SLEEP) {
+        features |= SR_FEATURE_SLEEP;
+    }
+    if (options & SR_OPTION_CONTACTS) {
+        features |= SR_FEATURE_CONTACTS;
+    }
+
+    return features;
+}
+
+/* Points the per body arrays of features into mem, which may be NULL, and returns the bytes they take */
+size_t sr_context_carve(sr_Context *ctx, void *mem, int cap, unsigned int features) {
+    size_t at;
+    int grid_cap, tree_cap, sleep_cap;
+
+    grid_cap = features & SR_FEATURE_GRID ? cap : 0;
+    tree_cap = features & SR_FEATURE_TREE ? cap : 0;
+    sleep_cap = features & SR_FEATURE_SLEEP ? cap : 0;
+
+    at = 0;
+    ctx->bodies = sr_carve_array(mem, &at, cap * sizeof(sr_Body));
+    ctx->bodies_sorted = sr_carve_array(mem, &at, cap * sizeof(sr_Body_Id));
+    ctx->bodies_tick_data = sr_carve_array(mem, &at, cap * sizeof(sr_Body_Tick_Data));
+    ctx->hot_sweep_min = sr_carve_array(mem, &at, cap * sizeof(sr_Scalar));
+    ctx->hot_sweep_max = sr_carve_array(mem, &at, cap * sizeof(sr_Scalar));
+    ctx->hot_cross_min = sr_carve_array(mem, &at, cap * sizeof(sr_Scalar));
+    ctx->hot_cross_max = sr_carve_array(mem, &at, cap * sizeof(sr_Scalar));
+    ctx->hot_flags = sr_carve_array(mem, &at, cap * sizeof(unsigned int));
+    ctx->hot_category = sr_carve_array(mem, &at, cap * sizeof(unsigned int));
+    ctx->hot_mask = sr_carve_array(mem, &at, cap * sizeof(unsigned int));
+    ctx->sort_keys = sr_carve_array(mem, &at, 2 * SR_SORT_KEY_WORDS * cap * sizeof(SR_U32));
+    ctx->sort_ids = sr_carve_array(mem, &at, cap * sizeof(sr_Body_Id));
+    ctx->grid_buckets = sr_carve_array(mem, &at, 2 * grid_cap * sizeof(int));
+    ctx->grid_entries = sr_carve_array(mem, &at, SR_GRID_MAX_CELLS * grid_cap * sizeof(sr_Grid_Entry));
+    ctx->grid_cells = sr_carve_array(mem, &at, 4 * grid_cap * sizeof(int));
+    ctx->grid_large = sr_carve_array(mem, &at, grid_cap * sizeof(sr_Body_Id));
+    ctx->tree_nodes = sr_carve_array(mem, &at, 2 * tree_cap * sizeof(sr_Tree_Node));
+    ctx->tree_proxy = sr_carve_array(mem, &at, tree_cap * sizeof(int));
+    ctx->tree_moved = sr_carve_array(mem, &at, (tree_cap + 31) / 32 * sizeof(SR_U32));
+    ctx->sleep_idle = sr_carve_array(mem, &at, sleep_cap * sizeof(int));
+    ctx->query_ids = sr_carve_array(mem, &at, cap * sizeof(sr_Body_Id));
+    ctx->query_sweep_min = sr_carve_array(mem, &at, cap * sizeof(sr_Scalar));
+    ctx->query_sweep_max = sr_carve_array(mem, &at, cap * sizeof(sr_Scalar));
+    ctx->query_cross_min = sr_carve_array(mem, &at, cap * sizeof(sr_Scalar));
+    ctx->query_cross_max = sr_carve_array(mem, &at, cap * sizeof(sr_Scalar));
+    ctx->query_reach = sr_carve_array(mem, &at, cap * sizeof(sr_Scalar));
+    ctx->prev_min = sr_carve_array(mem, &at, cap * sizeof(sr_Vec2));
+    ctx->sweep_saved = sr_carve_array(mem, &at, cap * sizeof(sr_Body_Id));
+    ctx->slot_generation = sr_carve_array(mem, &at, cap * sizeof(unsigned int));
+    ctx->slot_body = sr_carve_array(mem, &at, cap * sizeof(int));
+    ctx->body_slot = sr_carve_array(mem, &at, cap * sizeof(int));
+    ctx->free_slots = sr_carve_array(mem, &at, cap * sizeof(int));
+    ctx->free_bodies = sr_carve_array(mem, &at, cap * sizeof(int));
+    ctx->pass_min = sr_carve_array(mem, &at, cap * sizeof(sr_Vec2));
+    ctx->moved = sr_carve_array(mem, &at, (cap + 31) / 32 * sizeof(SR_U32));
+    ctx->sweep_pos = sr_carve_array(mem, &at, cap * sizeof(int));
+    ctx->sweep_long = sr_carve_array(mem, &at, cap * sizeof(sr_Body_Id));
+    ctx->child_blocks = sr_carve_array(mem, &at, cap * sizeof(int));
+    ctx->child_counts = sr_carve_array(mem, &at, cap * sizeof(int));
+
+    return at;
+}
+
+size_t sr_context_block_size(int cap, unsigned int features) {
+    sr_Context layout;
+
+    return sr_context_carve(&layout, NULL, cap, features);
+}
+
+#ifdef SR_STATS
+/* Counts an overlapping pair as resolved, or as skipped if both bodies are static */
+void sr_count_pair(const sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2, long *overlapping, long *both_static) {
+    if (ctx->bodies[id1].priority == SR_PRIORITY_STATIC && ctx->bodies[id2].priority == SR_PRIORITY_STATIC) {
+        ++*both_static;
+    } else {
+        ++*overlapping;
+    }
+}
+
+/* Adds the time since the current phase started to phase_time and starts the next phase */
+void sr_end_phase(sr_Context *ctx, double *phase_time) {
+    double now;
+
+    if (ctx->clock != NULL) {
+        now = ctx->clock(ctx->clock_user);
+        *phase_time += now - ctx->phase_start;
+        ctx->phase_start = now;
+    }
+}
+#endif
+
+void sr_resolve_bodies(sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
+    sr_Contact contact;
+
+    SR_STAT(sr_count_pair(ctx, id1, id2, &(ctx->stats.pairs_overlapping), &(ctx->stats.pairs_static));)
+
+    if (ctx->options & SR_OPTION_CONTACTS) {
+        sr_resolve_bodies_into(ctx, id1, id2, &(ctx->bodies_tick_data[id1]), &(ctx->bodies_tick_data[id2]), &contact);
+        sr_push_contact(ctx, &contact);
+    } else {
+        sr_resolve_bodies_into(ctx, id1, id2, &(ctx->bodies_tick_data[id1]), &(ctx->bodies_tick_data[id2]), NULL);
+    }
+}
+
+/* Sets up a context whose per body arrays were just carved for cap bodies */
+void sr_context_setup(sr_Context *ctx, int cap, sr_Sweep_Direction sdir, unsigned int features) {
+    ctx->num_bodies = 0;
+    ctx->bodies_cap = cap;
+    ctx->features = features;
+    ctx->fixed_memory = 0;
+    ctx->sweep_auto = sdir == SR_SWEEP_AUTO;
+    ctx->sweep_direction = ctx->sweep_auto ? SR_SWEEP_X : sdir;
+    ctx->num_sweep_saved = -1;
+    ctx->sweep_variance[0] = 0;
+    ctx->sweep_variance[1] = 0;
+    ctx->grid_cell_size = SR_SCALAR(64);
+    ctx->tree_roots[SR_TREE_DYNAMIC] = -1;
+    ctx->tree_roots[SR_TREE_STATIC] = -1;
+    ctx->tree_roots[SR_TREE_QUERY] = -1;
+    ctx->tree_free = -1;
+    if (features & SR_FEATURE_TREE) {
+        sr_tree_free_nodes(ctx, 0, 2 * cap);
+        sr_tree_mark_moved(ctx, -1);
+    }
+    ctx->options = 0;
+    ctx->num_sweep = 0;
+    ctx->static_dirty = 1;
+    ctx->parallel_for = NULL;
+    ctx->parallel_user = NULL;
+    ctx->chunks = NULL;
+    ctx->num_chunks = 0;
+    ctx->island_rects = NULL;
+    ctx->island_bodies_cap = 0;
+    ctx->island_pairs = NULL;
+    ctx->num_island_pairs = 0;
+    ctx->island_pairs_cap = 0;
+    ctx->num_islands = 0;
+    ctx->contacts = NULL;
+    ctx->prev_contacts = NULL;
+    ctx->contact_begins = NULL;
+    ctx->contact_ends = NULL;
+    ctx->num_contacts = 0;
+    ctx->num_prev_contacts = 0;
+    ctx->num_contact_begins = 0;
+    ctx->num_contact_ends = 0;
+    ctx->contacts_cap = 0;
+    ctx->contact_slots = NULL;
+    ctx->num_contact_slots = 0;
+    ctx->num_dropped_contacts = 0;
+    ctx->child_rects = NULL;
+    ctx->free_child_blocks = NULL;
+    ctx->num_child_blocks = 0;
+    ctx->num_free_child_blocks = 0;
+    ctx->child_blocks_cap = 0;
+    ctx->sleep_ticks = 60;
+    ctx->num_query = 0;
+    ctx->query_dirty = 1;
+    ctx->num_slots = 0;
+    ctx->num_free_slots = 0;
+    ctx->num_free_bodies = 0;
+    ctx->num_free_dropped = 0;
+    ctx->iterations = 1;
+    ctx->tiles = NULL;
+    ctx->tile_rects = NULL;
+    ctx->tile_spans = NULL;
+    ctx->tiles_width = 0;
+    ctx->tiles_height = 0;
+    ctx->tiles_dirty = 0;
+    ctx->tiles_origin.x = 0;
+    ctx->tiles_origin.y = 0;
+    ctx->tile_size = SR_SCALAR(1);
+    SR_STAT(memset(&(ctx->stats), 0, sizeof(ctx->stats));)
+    SR_STAT(ctx->clock = NULL;)
+    SR_STAT(ctx->clock_user = NULL;)
+}
+
+int sr_context_init(sr_Context *ctx, int expected_num_bodies, sr_Sweep_Direction sdir) {
+    void *mem;
+    unsigned int features;
+    int bodies_to_alloc;
+    SR_ASSERT(ctx != NULL && "cannot initialize null pointer");
+
+    if (expected_num_bodies == 0) {
+        bodies_to_alloc = 1;
+    } else {
+        bodies_to_alloc = expected_num_bodies;
+    }
+
+    features = sr_context_features(sdir, 0);
+    mem = SR_REALLOC(SR_ALLOC_CONTEXT, NULL, sr_context_block_size(bodies_to_alloc, features));
+    if (mem == NULL) {
+        ctx->bodies = NULL;
+        return -1;
+    } else {
+        sr_context_carve(ctx, mem, bodies_to_alloc, features);
+        sr_context_setup(ctx, bodies_to_alloc, sdir, features);
+
+        return 0;
+    }
+}
+
+/* The contacts a context made by sr_context_init_with_memory holds for cap bodies */
+int sr_fixed_contacts_cap(int cap) {
+    int contacts_cap;
+
+    if (SR_FIXED_CONTACTS_PER_BODY <= 0) {
+        return 0;
+    }
+
+    contacts_cap = 1;
+    while (contacts_cap < SR_FIXED_CONTACTS_PER_BODY * cap) {
+        contacts_cap *= 2;
+    }
+
+    return contacts_cap;
+}
+
+/* Points the contact lists and the slot table of ctx into mem after the per body arrays and returns the bytes they take */
+size_t sr_context_carve_contacts(sr_Context *ctx, void *mem, int contacts_cap) {
+    size_t at;
+
+    at = 0;
+    ctx->contacts = sr_carve_array(mem, &at, contacts_cap * sizeof(sr_Contact));
+    ctx->prev_contacts = sr_carve_array(mem, &at, contacts_cap * sizeof(sr_Contact));
+    ctx->contact_begins = sr_carve_array(mem, &at, contacts_cap * sizeof(sr_Contact));
+    ctx->contact_ends = sr_carve_array(mem, &at, contacts_cap * sizeof(sr_Contact));
+    ctx->contact_slots = sr_carve_array(mem, &at, 4 * contacts_cap * sizeof(sr_Contact_Slot));
+    if (mem != NULL) {
+        ctx->num_contact_slots = 4 * contacts_cap;
+        sr_clear_contact_slots(ctx);
+    }
+
+    return at;
+}
+
+/* The child blocks a context made by sr_context_init_with_memory holds for cap bodies */
+int sr_fixed_child_blocks_cap(int cap) {
+    return (cap + SR_FIXED_BODIES_PER_COMPOUND - 1) / SR_FIXED_BODIES_PER_COMPOUND;
+}
+
+/* Points the child block pool of ctx into mem and returns the bytes it takes */
+size_t sr_context_carve_children(sr_Context *ctx, void *mem, int blocks_cap) {
+    size_t at;
+
+    at = 0;
+    ctx->child_rects = sr_carve_array(mem, &at, SR_CHILD_BLOCK * blocks_cap * sizeof(sr_Rect));
+    ctx->free_child_blocks = sr_carve_array(mem, &at, blocks_cap * sizeof(int));
+
+    return at;
+}
+
+/* The bytes a context made by sr_context_init_with_memory takes for max_bodies bodies and the given features */
+size_t sr_context_fixed_size(int max_bodies, unsigned int features) {
+    sr_Context layout;
+    size_t bytes;
+
+    if (max_bodies < 1) {
+        max_bodies = 1;
+    }
+
+    /* room to align the start of the buffer */
+    bytes = SR_CACHE_LINE - 1 + sr_context_block_size(max_bodies, features);
+    bytes += sr_context_carve_children(&layout, NULL, sr_fixed_child_blocks_cap(max_bodies));
+    if (features & SR_FEATURE_CONTACTS) {
+        bytes += sr_context_carve_contacts(&layout, NULL, sr_fixed_contacts_cap(max_bodies));
+    }
+
+    return bytes;
+}
+
+size_t sr_context_memory_size(int max_bodies, sr_Sweep_Direction sdir, unsigned int options) {
+    return sr_context_fixed_size(max_bodies, sr_context_features(sdir, options));
+}
+
+/* Initializes ctx in the buffer for as many bodies as fit, the context never allocates, see the README */
+int sr_context_init_with_memory(sr_Context *ctx, void *memory, size_t bytes, sr_Sweep_Direction sdir, unsigned int options) {
+    char *mem;
+    size_t skip;
+    unsigned int features;
+    int lo, hi, mid;
+    SR_ASSERT(ctx != NULL && "cannot initialize null pointer");
+
+    features = sr_context_features(sdir, options);
+    if (memory == NULL || bytes < sr_context_fixed_size(1, features)) {
+        ctx->bodies = NULL;
+        return -1;
+    }
+
+    /* the largest capacity that fits, the size grows with the capacity */
+    lo = 1;
+    hi = 1;
+    while (hi <= SR_ID_INDEX_MASK && sr_context_fixed_size(hi * 2, features) <= bytes) {
+        hi *= 2;
+    }
+    hi *= 2;
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (sr_context_fixed_size(mid, features) <= bytes) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    mem = memory;
+    skip = (SR_CACHE_LINE - (size_t)mem % SR_CACHE_LINE) % SR_CACHE_LINE;
+    mem += skip;
+
+    sr_context_carve(ctx, mem, lo, features);
+    sr_context_setup(ctx, lo, sdir, features);
+    ctx->options = options;
+    ctx->fixed_memory = 1;
+    mem += sr_context_block_size(lo, features);
+    ctx->child_blocks_cap = sr_fixed_child_blocks_cap(lo);
+    mem += sr_context_carve_children(ctx, mem, ctx->child_blocks_cap);
+    ctx->contacts_cap = features & SR_FEATURE_CONTACTS ? sr_fixed_contacts_cap(lo) : 0;
+    ctx->num_contact_slots = 4 * ctx->contacts_cap;
+    if (ctx->contacts_cap > 0) {
+        sr_context_carve_contacts(ctx, mem, ctx->contacts_cap);
+    }
+
+    return 0;
+}
+
+void sr_context_deinit(sr_Context *ctx) {
+    sr_context_set_parallel_for(ctx, NULL, NULL, 0);
+    sr_context_set_tilemap(ctx, NULL, 0, 0, ctx->tiles_origin, SR_SCALAR(1));
+    if (!ctx->fixed_memory) {
+        SR_FREE(SR_ALLOC_CONTEXT, ctx->contacts);
+        SR_FREE(SR_ALLOC_CONTEXT, ctx->prev_contacts);
+        SR_FREE(SR_ALLOC_CONTEXT, ctx->contact_begins);
+        SR_FREE(SR_ALLOC_CONTEXT, ctx->contact_ends);
+        SR_FREE(SR_ALLOC_CONTEXT, ctx->contact_slots);
+        SR_FREE(SR_ALLOC_CONTEXT, ctx->child_rects);
+        SR_FREE(SR_ALLOC_CONTEXT, ctx->free_child_blocks);
+        SR_FREE(SR_ALLOC_CONTEXT, ctx->bodies);
+    }
+    ctx->contacts = NULL;
+    ctx->prev_contacts = NULL;
+    ctx->contact_begins = NULL;
+    ctx->contact_ends = NULL;
+    ctx->contact_slots = NULL;
+    ctx->num_contacts = 0;
+    ctx->num_prev_contacts = 0;
+    ctx->num_contact_begins = 0;
+    ctx->num_contact_ends = 0;
+    ctx->contacts_cap = 0;
+    ctx->num_contact_slots = 0;
+    ctx->child_rects = NULL;
+    ctx->free_child_blocks = NULL;
+    ctx->num_child_blocks = 0;
+    ctx->num_free_child_blocks = 0;
+    ctx->child_blocks_cap = 0;
+    ctx->bodies = NULL;
+    ctx->bodies_sorted = NULL;
+    ctx->bodies_tick_data = NULL;
+    ctx->hot_sweep_min = NULL;
+    ctx->hot_sweep_max = NULL;
+    ctx->hot_cross_min = NULL;
+    ctx->hot_cross_max = NULL;
+    ctx->hot_flags = NULL;
+    ctx->hot_category = NULL;
+    ctx->hot_mask = NULL;
+    ctx->sort_keys = NULL;
+    ctx->sort_ids = NULL;
+    ctx->grid_buckets = NULL;
+    ctx->grid_entries = NULL;
+    ctx->grid_cells = NULL;
+    ctx->grid_large = NULL;
+    ctx->tree_nodes = NULL;
+    ctx->tree_proxy = NULL;
+    ctx->tree_moved = NULL;
+    ctx->sleep_idle = NULL;
+    ctx->query_ids = NULL;
+    ctx->query_sweep_min = NULL;
+    ctx->query_sweep_max = NULL;
+    ctx->query_cross_min = NULL;
+    ctx->query_cross_max = NULL;
+    ctx->query_reach = NULL;
+    ctx->num_query = 0;
+    ctx->prev_min = NULL;
+    ctx->sweep_saved = NULL;
+    ctx->num_sweep_saved = -1;
+    ctx->slot_generation = NULL;
+    ctx->slot_body = NULL;
+    ctx->body_slot = NULL;
+    ctx->free_slots = NULL;
+    ctx->free_bodies = NULL;
+    ctx->pass_min = NULL;
+    ctx->moved = NULL;
+    ctx->sweep_pos = NULL;
+    ctx->sweep_extent = 0;
+    ctx->sweep_long = NULL;
+    ctx->num_sweep_long = 0;
+    ctx->sweep_indexed = 0;
+    ctx->child_blocks = NULL;
+    ctx->child_counts = NULL;
+    ctx->num_slots = 0;
+    ctx->num_free_slots = 0;
+    ctx->num_free_bodies = 0;
+    ctx->num_free_dropped = 0;
+    ctx->tree_roots[SR_TREE_DYNAMIC] = -1;
+    ctx->tree_roots[SR_TREE_STATIC] = -1;
+    ctx->tree_roots[SR_TREE_QUERY] = -1;
+    ctx->tree_free = -1;
+    ctx->options = 0;
+    ctx->num_sweep = 0;
+    ctx->static_dirty = 1;
+    ctx->num_bodies = 0;
+    ctx->bodies_cap = 0;
+    ctx->features = 0;
+    ctx->fixed_memory = 0;
+    ctx->sweep_direction = 0;
+    ctx->sweep_auto = 0;
+}
+
+void sr_context_clear(sr_Context *ctx) {
+    ctx->num_bodies = 0;
+    ctx->num_sweep = 0;
+    ctx->num_sweep_saved = -1;
+    ctx->num_query = 0;
+    ctx->query_dirty = 1;
+    ctx->num_slots = 0;
+    ctx->num_free_slots = 0;
+    ctx->num_free_bodies = 0;
+    ctx->num_free_dropped = 0;
+    ctx->static_dirty = 1;
+    ctx->tree_roots[SR_TREE_DYNAMIC] = -1;
+    ctx->tree_roots[SR_TREE_STATIC] = -1;
+    ctx->tree_roots[SR_TREE_QUERY] = -1;
+    ctx->tree_free = -1;
+    if (ctx->features & SR_FEATURE_TREE) {
+        sr_tree_free_nodes(ctx, 0, 2 * ctx->bodies_cap);
+    }
+}
+
+/* Moves the per body arrays into a new block for cap >= bodies_cap bodies with the optional arrays of features */
+int sr_context_relayout(sr_Context *ctx, int cap, unsigned int features) {
+    void *block;
+    sr_Context old;
+    int i;
+
+    if (ctx->fixed_memory) {
+        return -1;
+    }
+
+    block = SR_REALLOC(SR_ALLOC_CONTEXT, NULL, sr_context_block_size(cap, features));
+    if (block == NULL) {
+        return -1;
+    }
+
+    old = *ctx;
+    sr_context_carve(ctx, block, cap, features);
+    memcpy(ctx->bodies, old.bodies, ctx->num_bodies * sizeof(sr_Body));
+    memcpy(ctx->bodies_sorted, old.bodies_sorted, ctx->num_bodies * sizeof(sr_Body_Id));
+    memcpy(ctx->bodies_tick_data, old.bodies_tick_data, ctx->num_bodies * sizeof(sr_Body_Tick_Data));
+    memcpy(ctx->query_ids, old.query_ids, ctx->num_query * sizeof(sr_Body_Id));
+    memcpy(ctx->prev_min, old.prev_min, ctx->num_bodies * sizeof(sr_Vec2));
+    memcpy(ctx->slot_generation, old.slot_generation, ctx->num_slots * sizeof(unsigned int));
+    memcpy(ctx->slot_body, old.slot_body, ctx->num_slots * sizeof(int));
+    memcpy(ctx->body_slot, old.body_slot, ctx->num_bodies * sizeof(int));
+    memcpy(ctx->free_slots, old.free_slots, ctx->num_free_slots * sizeof(int));
+    memcpy(ctx->free_bodies, old.free_bodies, ctx->num_free_bodies * sizeof(int));
+    memcpy(ctx->child_blocks, old.child_blocks, ctx->num_bodies * sizeof(int));
+    memcpy(ctx->child_counts, old.child_counts, ctx->num_bodies * sizeof(int));
+
+    if (features & old.features & SR_FEATURE_TREE) {
+        memcpy(ctx->tree_nodes, old.tree_nodes, 2 * old.bodies_cap * sizeof(sr_Tree_Node));
+        memcpy(ctx->tree_proxy, old.tree_proxy, ctx->num_bodies * sizeof(int));
+        sr_tree_free_nodes(ctx, 2 * old.bodies_cap, 2 * cap);
+    } else {
+        ctx->tree_roots[SR_TREE_DYNAMIC] = -1;
+        ctx->tree_roots[SR_TREE_STATIC] = -1;
+        ctx->tree_roots[SR_TREE_QUERY] = -1;
+        ctx->tree_free = -1;
+        ctx->static_dirty = 1;
+    }
+    if (features & ~old.features & SR_FEATURE_TREE) {
+        sr_tree_free_nodes(ctx, 0, 2 * cap);
+        for (i = 0; i < ctx->num_bodies; ++i) {
+            ctx->tree_proxy[i] = -1;
+        }
+    }
+
+    if (features & old.features & SR_FEATURE_SLEEP) {
+        memcpy(ctx->sleep_idle, old.sleep_idle, ctx->num_bodies * sizeof(int));
+    } else if (features & SR_FEATURE_SLEEP) {
+        memset(ctx->sleep_idle, 0, ctx->num_bodies * sizeof(int));
+    }
+
+    SR_FREE(SR_ALLOC_CONTEXT, old.bodies);
+    ctx->bodies_cap = cap;
+    ctx->features = features;
+    ctx->num_sweep_saved = -1;
+    ctx->query_dirty = 1;
+    sr_tree_mark_moved(ctx, -1);
+
+    return 0;
+}
+
+/* Makes ctx hold the optional arrays of features, a fixed memory context only checks that it has them */
+
+int sr_context_set_features(sr_Context *ctx, unsigned int features) {
+    if (ctx->fixed_memory) {
+        return features & ~ctx->features ? -1 : 0;
+    } else if (((features ^ ctx->features) & ~SR_FEATURE_CONTACTS) == 0) {
+        /* contacts are allocated on their own */
+        ctx->features = features;
+        return 0;
+    } else {
+        return sr_context_relayout(ctx, ctx->bodies_cap, features);
+    }
+}
+
+int sr_context_set_sweep_direction(sr_Context *ctx, sr_Sweep_Direction sdir) {
+    if (sdir != SR_SWEEP_X && sdir != SR_SWEEP_Y && sdir != SR_BROADPHASE_GRID && sdir != SR_BROADPHASE_TREE && sdir != SR_SWEEP_AUTO) {
+        return -1;
+    } else if (sr_context_set_features(ctx, sr_context_features(sdir, ctx->options)) != 0) {
+        return -1;
+    } else if (sdir == SR_SWEEP_AUTO) {
+        /* keep sweeping the current axis until the variance says otherwise */
+        if (!ctx->sweep_auto && ctx->sweep_direction != SR_SWEEP_Y) {
+            ctx->sweep_direction = SR_SWEEP_X;
+            ctx->num_sweep_saved = -1;
+            ctx->query_dirty = 1;
+        }
+        ctx->sweep_auto = 1;
+
+        return 0;
+    } else {
+        if (sdir == SR_BROADPHASE_TREE && ctx->sweep_direction != SR_BROADPHASE_TREE) {
+            /* the leaves weren't kept up to date by the other broadphases */
+            sr_tree_mark_moved(ctx, -1);
+        }
+        ctx->sweep_direction = sdir;
+        ctx->sweep_auto = 0;
+        ctx->num_sweep_saved = -1;
+        ctx->query_dirty = 1;
+
+        return 0;
+    }
+}
+
+int sr_context_set_options(sr_Context *ctx, unsigned int options) {
+    sr_Sweep_Direction sdir;
+
+    sdir = ctx->sweep_auto ? SR_SWEEP_AUTO : ctx->sweep_direction;
+    if (sr_context_set_features(ctx, sr_context_features(sdir, options)) != 0) {
+        return -1;
+    }
+
+    if ((options ^ ctx->options) & SR_OPTION_STATIC_INDEX) {
+        ctx->num_sweep = ctx->num_bodies - ctx->num_free_dropped;
+        ctx->num_sweep_saved = -1;
+        ctx->static_dirty = 1;
+        sr_tree_mark_moved(ctx, -1);
+    }
+
+    if ((options ^ ctx->options) & SR_OPTION_CONTACTS) {
+        ctx->num_contacts = 0;
+        ctx->num_prev_contacts = 0;
+        ctx->num_contact_begins = 0;
+        ctx->num_contact_ends = 0;
+        ctx->num_dropped_contacts = 0;
+    }
+
+    ctx->options = options;
+
+    return 0;
+}
+
+void sr_context_set_sleep_ticks(sr_Context *ctx, int sleep_ticks) {
+    ctx->sleep_ticks = sleep_ticks > 0 ? sleep_ticks : 1;
+}
+
+/* Every iteration after the first re-tests only the pairs of bodies the one before moved, and none run once nothing moves */
+void sr_context_set_iterations(sr_Context *ctx, int iterations) {
+    ctx->iterations = iterations > 0 ? iterations : 1;
+}
+
+int sr_context_set_parallel_for(sr_Context *ctx, sr_Parallel_For parallel_for, void *user, int num_tasks) {
+    int i;
+
+    for (i = 0; i < ctx->num_chunks; ++i) {
+        SR_FREE(SR_ALLOC_CONTEXT, ctx->chunks[i].pairs);
+    }
+    SR_FREE(SR_ALLOC_CONTEXT, ctx->chunks);
+    SR_FREE(SR_ALLOC_CONTEXT, ctx->island_pairs);
+    SR_FREE(SR_ALLOC_CONTEXT, ctx->island_rects);
+    ctx->chunks = NULL;
+    ctx->num_chunks = 0;
+    ctx->island_rects = NULL;
+    ctx->island_bodies_cap = 0;
+    ctx->island_pairs = NULL;
+    ctx->num_island_pairs = 0;
+    ctx->island_pairs_cap = 0;
+    ctx->parallel_for = NULL;
+    ctx->parallel_user = NULL;
+
+    if (parallel_for == NULL) {
+        return 0;
+    } else if (num_tasks <= 0 || ctx->fixed_memory) {
+        return -1;
+    }
+
+    ctx->chunks = SR_REALLOC(SR_ALLOC_CONTEXT, NULL, num_tasks * sizeof(sr_Pair_Chunk));
+    if (ctx->chunks == NULL) {
+        return -1;
+    } else {
+        memset(ctx->chunks, 0, num_tasks * sizeof(sr_Pair_Chunk));
+        ctx->num_chunks = num_tasks;
+        ctx->parallel_for = parallel_for;
+        ctx->parallel_user = user;
+
+        return 0;
+    }
+}
+
+int sr_context_set_grid_cell_size(sr_Context *ctx, sr_Scalar cell_size) {
+    if (!(cell_size > 0)) {
+        return -1;
+    } else {
+        ctx->grid_cell_size = cell_size;
+
+        return 0;
+    }
+}
+
+sr_Body_Id sr_new_body(sr_Context *ctx, sr_Scalar xpos, sr_Scalar ypos, sr_Scalar xdim, sr_Scalar ydim, sr_Attach_Location loc, int priority, unsigned int flags, unsigned int custom_flags) {
+    sr_Body b;
+
+    b.priority = priority;
+    b.flags = flags;
+    b.custom_flags = custom_flags;
+    b.category = 1u;
+    b.mask = ~0u;
+
+    switch (loc) {
+    case SR_CENTER:
+        b.offset.x = sr_half(xdim);
+        b.offset.y = sr_half(ydim);
+        break;
+    case SR_TOP_CENTER:
+        b.offset.x = sr_half(xdim);
+        b.offset.y = 0;
+        break;
+    case SR_TOP_RIGHT:
+        b.offset.x = xdim;
+        b.offset.y = 0;
+        break;
+    case SR_CENTER_RIGHT:
+        b.offset.x = xdim;
+        b.offset.y = sr_half(ydim);
+        break;
+    case SR_BOTTOM_RIGHT:
+        b.offset.x = xdim;
+        b.offset.y = ydim;
+        break;
+    case SR_BOTTOM_CENTER:
+        b.offset.x = sr_half(xdim);
+        b.offset.y = ydim;
+        break;
+    case SR_BOTTOM_LEFT:
+        b.offset.x = 0;
+        b.offset.y = ydim;
+        break;
+    case SR_CENTER_LEFT:
+        b.offset.x = 0;
+        b.offset.y = sr_half(ydim);
+        break;
+    case SR_TOP_LEFT:
+        b.offset.x = 0;
+        b.offset.y = 0;
+        break;
+    }
+
+    b.r.min.x = xpos - b.offset.x;
+    b.r.min.y = ypos - b.offset.y;
+    b.r.max.x = b.r.min.x + xdim;
+    b.r.max.y = b.r.min.y + ydim;
+
+    return sr_register_body(ctx, b);
+}
+
+/* Makes room for num_bodies bodies up front so registering them doesn't allocate.
+ * Returns -1 if they don't fit into the memory of a context made by sr_context_init_with_memory. */
+int sr_context_reserve(sr_Context *ctx, int num_bodies) {
+    if (ctx == NULL) {
+        return -1;
+    } else if (num_bodies <= ctx->bodies_cap) {
+        return 0;
+    } else {
+        return sr_context_relayout(ctx, num_bodies, ctx->features);
+    }
+}
+
+/* Puts body id at the end of bodies_sorted, keeping the swept bodies in front of the static ones */
+void sr_sort_in_body(sr_Context *ctx, int id) {
+    int end;
+
+    end = ctx->num_bodies - ctx->num_free_dropped;
+    if (ctx->bodies[id].priority == SR_PRIORITY_STATIC && ctx->options & SR_OPTION_STATIC_INDEX) {
+        ctx->bodies_sorted[end] = id;
+        ctx->static_dirty = 1;
+    } else {
+        ctx->bodies_sorted[end] = ctx->bodies_sorted[ctx->num_sweep];
+        ctx->bodies_sorted[ctx->num_sweep] = id;
+        ++ctx->num_sweep;
+    }
+    ctx->num_sweep_saved = -1;
+}
+
+/* Sets up the per body state of a new body at index id */
+void sr_init_body(sr_Context *ctx, int id, sr_Body b) {
+    ctx->bodies[id] = b;
+    if (ctx->features & SR_FEATURE_TREE) {
+        ctx->tree_proxy[id] = -1;
+    }
+    sr_reset_idle(ctx, id);
+    sr_tree_mark_moved(ctx, id);
+    ctx->child_blocks[id] = -1;
+    ctx->child_counts[id] = 0;
+    ctx->prev_min[id] = b.r.min;
+    ctx->query_dirty = 1;
+}
+
+sr_Body_Id sr_register_body(sr_Context *ctx, sr_Body b) {
+    int next_id, slot;
+
+    if (ctx == NULL) {
+        return -1;
+    } else if (ctx->num_free_slots == 0 && ctx->num_slots > SR_ID_INDEX_MASK) {
+        return -1;
+    }
+
+    if (ctx->num_free_bodies > ctx->num_free_dropped) {
+        /* removed since the last tick, so it still has its place in bodies_sorted and the query index */
+        next_id = ctx->free_bodies[--ctx->num_free_bodies];
+        if (ctx->options & SR_OPTION_STATIC_INDEX && (b.priority == SR_PRIORITY_STATIC || ctx->bodies[next_id].priority == SR_PRIORITY_STATIC)) {
+            ctx->static_dirty = 1;
+        }
+        sr_init_body(ctx, next_id, b);
+    } else if (ctx->num_free_bodies > 0) {
+        next_id = ctx->free_bodies[--ctx->num_free_bodies];
+        sr_init_body(ctx, next_id, b);
+        sr_sort_in_body(ctx, next_id);
+        --ctx->num_free_dropped;
+    } else {
+        next_id = ctx->num_bodies;
+        if (ctx->num_bodies >= ctx->bodies_cap && sr_context_relayout(ctx, ctx->bodies_cap * 2, ctx->features) != 0) {
+            return -1;
+        }
+        sr_init_body(ctx, next_id, b);
+        sr_sort_in_body(ctx, next_id);
+        ++ctx->num_bodies;
+    }
+
+    if (ctx->num_free_slots > 0) {
+        slot = ctx->free_slots[--ctx->num_free_slots];
+    } else {
+        slot = ctx->num_slots++;
+        ctx->slot_generation[slot] = 0;
+    }
+    ctx->slot_body[slot] = next_id;
+    ctx->body_slot[next_id] = slot;
+
+    return sr_body_handle(ctx, next_id);
+}
+
+int sr_place_body(sr_Context *ctx, sr_Body_Id id, sr_Scalar xpos, sr_Scalar ypos) {
+    sr_Vec2 min_to_max;
+
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else if (ctx->bodies[id].flags & SR_DISABLED) {
+        return 0;
+    } else {
+        if (ctx->bodies[id].priority == SR_PRIORITY_STATIC) {
+            ctx->static_dirty = 1;
+        }
+        sr_reset_idle(ctx, id);
+        sr_tree_mark_moved(ctx, id);
+        ctx->query_dirty = 1;
+
+        min_to_max.x = ctx->bodies[id].r.max.x - ctx->bodies[id].r.min.x;
+        min_to_max.y = ctx->bodies[id].r.max.y - ctx->bodies[id].r.min.y;
+
+        ctx->bodies[id].r.min.x = xpos - ctx->bodies[id].offset.x;
+        ctx->bodies[id].r.min.y = ypos - ctx->bodies[id].offset.y;
+
+        ctx->bodies[id].r.max.x = min_to_max.x + ctx->bodies[id].r.min.x;
+        ctx->bodies[id].r.max.y = min_to_max.y + ctx->bodies[id].r.min.y;
+
+        /* placing teleports, so continuous bodies don't sweep from where they were */
+        ctx->prev_min[id] = ctx->bodies[id].r.min;
+
+        return 0;
+    }
+}
+
+int sr_translate_body(sr_Context *ctx, sr_Body_Id id, sr_Scalar xmove, sr_Scalar ymove) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else if (ctx->bodies[id].flags & SR_DISABLED || ctx->bodies[id].priority == SR_PRIORITY_STATIC) {
+        return 0;
+    } else {
+        ctx->bodies[id].r.min.x += xmove;
+        ctx->bodies[id].r.min.y += ymove;
+        ctx->bodies[id].r.max.x += xmove;
+        ctx->bodies[id].r.max.y += ymove;
+
+        if (xmove != 0 || ymove != 0) {
+            sr_reset_idle(ctx, id);
+            sr_tree_mark_moved(ctx, id);
+            ctx->query_dirty = 1;
+        }
+
+        return 0;
+    }
+}
+
+int sr_set_body_layers(sr_Context *ctx, sr_Body_Id id, unsigned int category, unsigned int mask) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        ctx->bodies[id].category = category;
+        ctx->bodies[id].mask = mask;
+        /* the body's pairs change, so it can't keep sleeping on the old ones */
+        sr_reset_idle(ctx, id);
+
+        return 0;
+    }
+}
+
+/* Gives the body at index id a child block holding its own rect, returns -1 if the pool can't grow */
+int sr_take_child_block(sr_Context *ctx, int id) {
+    sr_Body *b;
+    sr_Rect *own;
+    int block;
+
+    if (ctx->num_free_child_blocks > 0) {
+        block = ctx->free_child_blocks[--ctx->num_free_child_blocks];
+    } else if (ctx->num_child_blocks < ctx->child_blocks_cap || sr_reserve_child_blocks(ctx, ctx->num_child_blocks + 1) == 0) {
+        block = ctx->num_child_blocks++;
+    } else {
+        return -1;
+    }
+
+    b = &(ctx->bodies[id]);
+    own = &(ctx->child_rects[block * SR_CHILD_BLOCK]);
+    own->min.x = -b->offset.x;
+    own->min.y = -b->offset.y;
+    own->max.x = own->min.x + (b->r.max.x - b->r.min.x);
+    own->max.y = own->min.y + (b->r.max.y - b->r.min.y);
+    ctx->child_blocks[id] = block;
+
+    return 0;
+}
+
+/* Returns the child block of the body at index id to the pool */
+void sr_release_child_block(sr_Context *ctx, int id) {
+    if (ctx->child_blocks[id] != -1) {
+        ctx->free_child_blocks[ctx->num_free_child_blocks++] = ctx->child_blocks[id];
+        ctx->child_blocks[id] = -1;
+    }
+    ctx->child_counts[id] = 0;
+}
+
+int sr_set_body_children(sr_Context *ctx, sr_Body_Id id, const sr_Rect *children, int num_children) {
+    sr_Body *b;
+    sr_Rect *rects;
+    sr_Vec2 pos;
+    sr_Rect box;
+    int i;
+
+    id = sr_body_index(ctx, id);
+    if (id < 0 || num_children < 0 || num_children > SR_MAX_CHILDREN) {
+        return -1;
+    }
+
+    for (i = 0; i < num_children; ++i) {
+        if (!(children[i].min.x <= children[i].max.x && children[i].min.y <= children[i].max.y)) {
+            return -1;
+        }
+    }
+
+    if (num_children == 0 && ctx->child_blocks[id] == -1) {
+        return 0;
+    } else if (ctx->child_blocks[id] == -1 && sr_take_child_block(ctx, id) != 0) {
+        return -1;
+    }
+
+    rects = &(ctx->child_rects[ctx->child_blocks[id] * SR_CHILD_BLOCK]);
+    if (num_children == 0) {
+        box = rects[0];
+        sr_release_child_block(ctx, id);
+    } else {
+        box = children[0];
+        for (i = 1; i < num_children; ++i) {
+            box = sr_rect_union(box, children[i]);
+        }
+        for (i = 0; i < num_children; ++i) {
+            rects[i + 1].min.x = children[i].min.x - box.min.x;
+            rects[i + 1].min.y = children[i].min.y - box.min.y;
+            rects[i + 1].max.x = children[i].max.x - box.min.x;
+            rects[i + 1].max.y = children[i].max.y - box.min.y;
+        }
+        ctx->child_counts[id] = num_children;
+    }
+
+    b = &(ctx->bodies[id]);
+    pos.x = b->r.min.x + b->offset.x;
+    pos.y = b->r.min.y + b->offset.y;
+    b->offset.x = -box.min.x;
+    b->offset.y = -box.min.y;
+    b->r.min.x = pos.x + box.min.x;
+    b->r.min.y = pos.y + box.min.y;
+    b->r.max.x = pos.x + box.max.x;
+    b->r.max.y = pos.y + box.max.y;
+
+    if (b->priority == SR_PRIORITY_STATIC) {
+        ctx->static_dirty = 1;
+    }
+    sr_reset_idle(ctx, id);
+    sr_tree_mark_moved(ctx, id);
+    ctx->query_dirty = 1;
+    /* the box changed shape, continuous bodies don't sweep from the old one */
+    ctx->prev_min[id] = b->r.min;
+
+    return 0;
+}
+
+/* Returns -1 if a batch names a body that doesn't exist, which the batch functions check before touching anything */
+int sr_batch_check(const sr_Context *ctx, const sr_Body_Id *ids, int first, int count) {
+    int i;
+
+    if (count < 0) {
+        return -1;
+    } else if (ids == NULL) {
+        return first < 0 || first > ctx->num_bodies - count ? -1 : 0;
+    }
+
+    for (i = 0; i < count; ++i) {
+        if (sr_body_index(ctx, ids[i]) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* The index of body i of a checked batch, ids may repeat a body */
+int sr_batch_index(const sr_Context *ctx, const sr_Body_Id *ids, int first, int i) {
+    return ids != NULL ? sr_body_index(ctx, ids[i]) : first + i;
+}
+
+int sr_place_bodies(sr_Context *ctx, const sr_Body_Id *ids, int first, int count, const sr_Vec2 *positions) {
+    sr_Body *b;
+    sr_Scalar w, h;
+    int i, j, placed_static;
+
+    if (sr_batch_check(ctx, ids, first, count) != 0) {
+        return -1;
+    }
+
+    placed_static = 0;
+    for (i = 0; i < count; ++i) {
+        j = sr_batch_index(ctx, ids, first, i);
+        b = &(ctx->bodies[j]);
+        if (b->flags & SR_DISABLED) {
+            continue;
+        }
+        placed_static |= b->priority == SR_PRIORITY_STATIC;
+
+        w = b->r.max.x - b->r.min.x;
+        h = b->r.max.y - b->r.min.y;
+        b->r.min.x = positions[i].x - b->offset.x;
+        b->r.min.y = positions[i].y - b->offset.y;
+        b->r.max.x = w + b->r.min.x;
+        b->r.max.y = h + b->r.min.y;
+        ctx->prev_min[j] = b->r.min;
+        sr_reset_idle(ctx, j);
+        sr_tree_mark_moved(ctx, j);
+    }
+
+    if (placed_static) {
+        ctx->static_dirty = 1;
+    }
+    if (count > 0) {
+        ctx->query_dirty = 1;
+    }
+
+    return 0;
+}
+
+int sr_translate_bodies(sr_Context *ctx, const sr_Body_Id *ids, int first, int count, const sr_Vec2 *moves) {
+    sr_Body *b;
+    int i, j, moved, any_moved;
+
+    if (sr_batch_check(ctx, ids, first, count) != 0) {
+        return -1;
+    }
+
+    any_moved = 0;
+    for (i = 0; i < count; ++i) {
+        j = sr_batch_index(ctx, ids, first, i);
+        b = &(ctx->bodies[j]);
+        if (b->flags & SR_DISABLED || b->priority == SR_PRIORITY_STATIC) {
+            continue;
+        }
+
+        b->r.min.x += moves[i].x;
+        b->r.min.y += moves[i].y;
+        b->r.max.x += moves[i].x;
+        b->r.max.y += moves[i].y;
+        moved = moves[i].x != 0 || moves[i].y != 0;
+        if (moved) {
+            sr_reset_idle(ctx, j);
+            sr_tree_mark_moved(ctx, j);
+        }
+        any_moved |= moved;
+    }
+
+    if (any_moved) {
+        ctx->query_dirty = 1;
+    }
+
+    return 0;
+}
+
+int sr_get_body_pos(sr_Vec2 *pos_out, const sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        pos_out->x = ctx->bodies[id].r.min.x + ctx->bodies[id].offset.x;
+        pos_out->y = ctx->bodies[id].r.min.y + ctx->bodies[id].offset.y;
+
+        return 0;
+    }
+}
+
+int sr_get_body_pos_comp(sr_Scalar *xpos_out, sr_Scalar *ypos_out, const sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        *xpos_out = ctx->bodies[id].r.min.x + ctx->bodies[id].offset.x;
+        *ypos_out = ctx->bodies[id].r.min.y + ctx->bodies[id].offset.y;
+
+        return 0;
+    }
+}
+
+int sr_get_body_dim(sr_Vec2 *dim_out, const sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        dim_out->x = ctx->bodies[id].r.max.x - ctx->bodies[id].r.min.x;
+        dim_out->y = ctx->bodies[id].r.max.y - ctx->bodies[id].r.min.y;
+
+        return 0;
+    }
+}
+
+int sr_get_body_dim_comp(sr_Scalar *xdim_out, sr_Scalar *ydim_out, const sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        *xdim_out = ctx->bodies[id].r.max.x - ctx->bodies[id].r.min.x;
+        *ydim_out = ctx->bodies[id].r.max.y - ctx->bodies[id].r.min.y;
+
+        return 0;
+    }
+}
+
+int sr_get_body_rect(sr_Rect *rect_out, const sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        *rect_out = ctx->bodies[id].r;
+        return 0;
+    }
+}
+
+int sr_get_body_rect_comp(sr_Scalar *xmin_out, sr_Scalar *ymin_out, sr_Scalar *xmax_out, sr_Scalar *ymax_out, const sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        *xmin_out = ctx->bodies[id].r.min.x;
+        *ymin_out = ctx->bodies[id].r.min.y;
+        *xmax_out = ctx->bodies[id].r.max.x;
+        *ymax_out = ctx->bodies[id].r.max.y;
+
+        return 0;
+    }
+}
+
+int sr_get_body_child_rect(sr_Rect *rect_out, const sr_Context *ctx, sr_Body_Id id, int child) {
+    id = sr_body_index(ctx, id);
+    if (id < 0 || child < 0 || child >= ctx->child_counts[id]) {
+        return -1;
+    } else {
+        sr_child_rect(rect_out, &(ctx->bodies[id]), sr_body_children(ctx, id), ctx->child_counts[id], child);
+        return 0;
+    }
+}
+
+int sr_get_bodies_pos(void *pos_out, int stride, const sr_Context *ctx, const sr_Body_Id *ids, int first, int count) {
+    const sr_Body *b;
+    sr_Scalar *out;
+    int i, j;
+
+    if (sr_batch_check(ctx, ids, first, count) != 0) {
+        return -1;
+    }
+
+    if (ids == NULL) {
+        b = &(ctx->bodies[first]);
+        for (i = 0; i < count; ++i) {
+            out = (sr_Scalar *)((char *)pos_out + (long)i * stride);
+            out[0] = b[i].r.min.x + b[i].offset.x;
+            out[1] = b[i].r.min.y + b[i].offset.y;
+        }
+    } else {
+        for (i = 0; i < count; ++i) {
+            j = sr_body_index(ctx, ids[i]);
+            out = (sr_Scalar *)((char *)pos_out + (long)i * stride);
+            out[0] = ctx->bodies[j].r.min.x + ctx->bodies[j].offset.x;
+            out[1] = ctx->bodies[j].r.min.y + ctx->bodies[j].offset.y;
+        }
+    }
+
+    return 0;
+}
+
+int sr_get_bodies_rect(void *rect_out, int stride, const sr_Context *ctx, const sr_Body_Id *ids, int first, int count) {
+    const sr_Body *b;
+    sr_Scalar *out;
+    int i, j;
+
+    if (sr_batch_check(ctx, ids, first, count) != 0) {
+        return -1;
+    }
+
+    if (ids == NULL) {
+        b = &(ctx->bodies[first]);
+        for (i = 0; i < count; ++i) {
+            out = (sr_Scalar *)((char *)rect_out + (long)i * stride);
+            out[0] = b[i].r.min.x;
+            out[1] = b[i].r.min.y;
+            out[2] = b[i].r.max.x;
+            out[3] = b[i].r.max.y;
+        }
+    } else {
+        for (i = 0; i < count; ++i) {
+            j = sr_body_index(ctx, ids[i]);
+            out = (sr_Scalar *)((char *)rect_out + (long)i * stride);
+            out[0] = ctx->bodies[j].r.min.x;
+            out[1] = ctx->bodies[j].r.min.y;
+            out[2] = ctx->bodies[j].r.max.x;
+            out[3] = ctx->bodies[j].r.max.y;
+        }
+    }
+
+    return 0;
+}
+
+int sr_do_bodies_overlap(sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
+    id1 = sr_body_index(ctx, id1);
+    id2 = sr_body_index(ctx, id2);
+    if (id1 < 0 || id2 < 0) {
+        return -1;
+    } else {
+        return sr_do_rects_overlap(ctx->bodies[id1].r, ctx->bodies[id2].r);
+    }
+}
+
+int sr_get_body_to_body_vector(sr_Vec2 *vec_out, sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
+    id1 = sr_body_index(ctx, id1);
+    id2 = sr_body_index(ctx, id2);
+    if (id1 < 0 || id2 < 0) {
+        return -1;
+    } else {
+        vec_out->x = sr_half(ctx->bodies[id2].r.max.x + ctx->bodies[id2].r.min.x) - sr_half(ctx->bodies[id1].r.max.x + ctx->bodies[id1].r.min.x);
+        vec_out->y = sr_half(ctx->bodies[id2].r.max.y + ctx->bodies[id2].r.min.y) - sr_half(ctx->bodies[id1].r.max.y + ctx->bodies[id1].r.min.y);
+
+        return 0;
+    }
+}
+
+int sr_get_body_to_body_vector_comp(sr_Scalar *xvec_out, sr_Scalar *yvec_out, sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
+    id1 = sr_body_index(ctx, id1);
+    id2 = sr_body_index(ctx, id2);
+    if (id1 < 0 || id2 < 0) {
+        return -1;
+    } else {
+        *xvec_out = sr_half(ctx->bodies[id2].r.max.x + ctx->bodies[id2].r.min.x) - sr_half(ctx->bodies[id1].r.max.x + ctx->bodies[id1].r.min.x);
+        *yvec_out = sr_half(ctx->bodies[id2].r.max.y + ctx->bodies[id2].r.min.y) - sr_half(ctx->bodies[id1].r.max.y + ctx->bodies[id1].r.min.y);
+
+        return 0;
+    }
+}
+
+int sr_get_body_tick_data(sr_Body_Tick_Data *data_out, sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        *data_out = ctx->bodies_tick_data[id];
+
+        return 0;
+    }
+}
+
+int sr_did_body_collide(sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+int sr_did_body_collide_wall(sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_RIGHT_WALL || ctx->bodies_tick_data[id].flags & SR_COLLIDED_LEFT_WALL) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+int sr_did_body_collide_ceiling(sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_CEILING) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+int sr_did_body_collide_right_wall(sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_RIGHT_WALL) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+int sr_did_body_collide_floor(sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_FLOOR) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+int sr_did_body_collide_left_wall(sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_LEFT_WALL) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+int sr_did_body_collide_up(sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_UP) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+int sr_did_body_collide_right(sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_RIGHT) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+int sr_did_body_collide_down(sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_DOWN) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+int sr_did_body_collide_left(sr_Context *ctx, sr_Body_Id id) {
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    } else {
+        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_LEFT) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+int sr_get_contacts(const sr_Contact **contacts_out, int *num_contacts_out, const sr_Context *ctx) {
+    if (!(ctx->options & SR_OPTION_CONTACTS)) {
+        return -1;
+    } else {
+        *contacts_out = ctx->contacts;
+        *num_contacts_out = ctx->num_contacts;
+
+        return 0;
+    }
+}
+
+int sr_get_contact_begins(const sr_Contact **contacts_out, int *num_contacts_out, const sr_Context *ctx) {
+    if (!(ctx->options & SR_OPTION_CONTACTS)) {
+        return -1;
+    } else {
+        *contacts_out = ctx->contact_begins;
+        *num_contacts_out = ctx->num_contact_begins;
+
+        return 0;
+    }
+}
+
+int sr_get_contact_ends(const sr_Contact **contacts_out, int *num_contacts_out, const sr_Context *ctx) {
+    if (!(ctx->options & SR_OPTION_CONTACTS)) {
+        return -1;
+    } else {
+        *contacts_out = ctx->contact_ends;
+        *num_contacts_out = ctx->num_contact_ends;
+
+        return 0;
+    }
+}
+
+/* Brings the query index, or the trees of the tree broadphase, up to date with the bodies */
+void sr_update_query_index(sr_Context *ctx) {
+    const sr_Rect *r;
+    int i;
+
+    if (!ctx->query_dirty) {
+        return;
+    } else if (ctx->sweep_direction == SR_BROADPHASE_TREE) {
+        if (ctx->options & SR_OPTION_STATIC_INDEX && ctx->static_dirty) {
+            sr_rebuild_static_index(ctx);
+        }
+        sr_tree_update_moved(ctx);
+        ctx->query_dirty = 0;
+        return;
+    }
+
+    if ((ctx->sweep_direction == SR_SWEEP_X || ctx->sweep_direction == SR_SWEEP_Y) && ctx->num_sweep == ctx->num_bodies - ctx->num_free_dropped) {
+        /* the sweep sorted every body along the same axis, which leaves little for the sort to do */
+        memcpy(ctx->query_ids, ctx->bodies_sorted, ctx->num_sweep * sizeof(sr_Body_Id));
+        memcpy(ctx->query_ids + ctx->num_sweep, ctx->free_bodies, ctx->num_free_dropped * sizeof(sr_Body_Id));
+    } else {
+        for (i = ctx->num_query; i < ctx->num_bodies; ++i) {
+            ctx->query_ids[i] = i;
+        }
+    }
+    ctx->num_query = ctx->num_bodies;
+
+    sr_stable_sort(ctx, ctx->query_ids, ctx->num_query);
+
+    for (i = 0; i < ctx->num_query; ++i) {
+        r = &(ctx->bodies[ctx->query_ids[i]].r);
+        if (ctx->sweep_direction == SR_SWEEP_X) {
+            ctx->query_sweep_min[i] = r->min.x;
+            ctx->query_sweep_max[i] = r->max.x;
+            ctx->query_cross_min[i] = r->min.y;
+            ctx->query_cross_max[i] = r->max.y;
+        } else {
+            ctx->query_sweep_min[i] = r->min.y;
+            ctx->query_sweep_max[i] = r->max.y;
+            ctx->query_cross_min[i] = r->min.x;
+            ctx->query_cross_max[i] = r->max.x;
+        }
+        ctx->query_reach[i] = i > 0 && ctx->query_reach[i - 1] > ctx->query_sweep_max[i] ? ctx->query_reach[i - 1] : ctx->query_sweep_max[i];
+    }
+
+    ctx->query_dirty = 0;
+}
+
+/* Returns the first sorted position whose body may reach back to smin, i.e. no earlier body ends at or after smin */
+int sr_query_first(const sr_Context *ctx, sr_Scalar smin) {
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = ctx->num_query;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ctx->query_reach[mid] < smin) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* Returns the first sorted position whose body starts after smax */
+int sr_query_end(const sr_Context *ctx, sr_Scalar smax) {
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = ctx->num_query;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ctx->query_sweep_min[mid] > smax) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return lo;
+}
+
+int sr_query_accepts(const sr_Context *ctx, sr_Body_Id id, unsigned int filter) {
+    return !(ctx->bodies[id].flags & SR_DISABLED) && (filter == 0 || ctx->bodies[id].custom_flags & filter);
+}
+
+/* sr_query_append() for the tree broadphase, walks every tree */
+int sr_tree_query_append(sr_Body_Id *ids_out, int max_out, int num_out, const sr_Context *ctx, sr_Rect rect, unsigned int filter) {
+    const sr_Tree_Node *n;
+    int stack[SR_TREE_STACK_SIZE];
+    int tree, top;
+
+    for (tree = SR_TREE_DYNAMIC; tree <= SR_TREE_QUERY; ++tree) {
+        top = 0;
+        if (ctx->tree_roots[tree] != -1) {
+            stack[top++] = ctx->tree_roots[tree];
+        }
+
+        while (top > 0) {
+            n = &(ctx->tree_nodes[stack[--top]]);
+            if (!sr_do_rects_overlap(n->aabb, rect)) {
+                continue;
+            } else if (n->child1 != -1) {
+                SR_ASSERT(top + 2 <= SR_TREE_STACK_SIZE && "tree too deep for SR_TREE_STACK_SIZE");
+                stack[top++] = n->child2;
+                stack[top++] = n->child1;
+            } else if (sr_do_rects_overlap(ctx->bodies[n->body].r, rect) && sr_query_accepts(ctx, n->body, filter)) {
+                if (num_out < max_out) {
+                    ids_out[num_out] = n->body;
+                }
+                ++num_out;
+            }
+        }
+    }
+
+    return num_out;
+}
+
+/* Appends the bodies overlapping rect to ids_out from position num_out on, returns the new total, which can exceed max_out */
+int sr_query_append(sr_Body_Id *ids_out, int max_out, int num_out, const sr_Context *ctx, sr_Rect rect, unsigned int filter) {
+    sr_Scalar smin, smax, cmin, cmax;
+    int k, end;
+
+    if (ctx->sweep_direction == SR_BROADPHASE_TREE) {
+        return sr_tree_query_append(ids_out, max_out, num_out, ctx, rect, filter);
+    } else if (ctx->sweep_direction == SR_SWEEP_X) {
+        smin = rect.min.x;
+        smax = rect.max.x;
+        cmin = rect.min.y;
+        cmax = rect.max.y;
+    } else {
+        smin = rect.min.y;
+        smax = rect.max.y;
+        cmin = rect.min.x;
+        cmax = rect.max.x;
+    }
+
+    end = sr_query_end(ctx, smax);
+    for (k = sr_query_first(ctx, smin); k < end; ++k) {
+        if (ctx->query_sweep_max[k] < smin || ctx->query_cross_min[k] > cmax || ctx->query_cross_max[k] < cmin) {
+            continue;
+        } else if (sr_query_accepts(ctx, ctx->query_ids[k], filter)) {
+            if (num_out < max_out) {
+                ids_out[num_out] = ctx->query_ids[k];
+            }
+            ++num_out;
+        }
+    }
+
+    return num_out;
+}
+
+/* Turns the body indices written by sr_query_append() into handles */
+void sr_query_handles(sr_Body_Id *ids, int count, int max_out, const sr_Context *ctx) {
+    int i;
+
+    for (i = 0; i < count && i < max_out; ++i) {
+        ids[i] = sr_body_handle(ctx, ids[i]);
+    }
+}
+
+/* Writes up to max_out ids of the bodies overlapping rect, returns how many there are in total */
+int sr_query_rect(sr_Body_Id *ids_out, int max_out, sr_Context *ctx, sr_Rect rect, unsigned int filter) {
+    int count;
+
+    sr_update_query_index(ctx);
+    count = sr_query_append(ids_out, max_out, 0, ctx, rect, filter);
+    sr_query_handles(ids_out, count, max_out, ctx);
+
+    return count;
+}
+
+int sr_query_point(sr_Body_Id *ids_out, int max_out, sr_Context *ctx, sr_Vec2 point, unsigned int filter) {
+    sr_Rect rect;
+
+    rect.min = point;
+    rect.max = point;
+
+    return sr_query_rect(ids_out, max_out, ctx, rect, filter);
+}
+
+/* Runs num_rects rect queries into ids_out and counts_out, returns the total, which can exceed max_out */
+
+int sr_query_rects(sr_Body_Id *ids_out, int max_out, int *counts_out, sr_Context *ctx, const sr_Rect *rects, int num_rects, unsigned int filter) {
+    int i, total, before;
+
+    sr_update_query_index(ctx);
+
+    total = 0;
+    for (i = 0; i < num_rects; ++i) {
+        before = total;
+        total = sr_query_append(ids_out, max_out, total, ctx, rects[i], filter);
+        counts_out[i] = total - before;
+    }
+    sr_query_handles(ids_out, total, max_out, ctx);
+
+    return total;
+}
+
+/* Wakes the bodies touching r, which may have been resting on a body removed from there */
+void sr_wake_around(sr_Context *ctx, sr_Rect r) {
+    int k, count;
+
+    sr_update_query_index(ctx);
+    count = sr_query_append(ctx->sort_ids, ctx->num_bodies, 0, ctx, r, 0);
+    for (k = 0; k < count; ++k) {
+        if (ctx->sleep_idle[ctx->sort_ids[k]] > 1) {
+            ctx->sleep_idle[ctx->sort_ids[k]] = 1;
+        }
+    }
+}
+
+/* Removes a body, its place stays a disabled body until the next new body or sr_context_compact() takes it */
+int sr_remove_body(sr_Context *ctx, sr_Body_Id id) {
+    int slot;
+
+    id = sr_body_index(ctx, id);
+    if (id < 0) {
+        return -1;
+    }
+
+    slot = ctx->body_slot[id];
+    ctx->slot_generation[slot] = (ctx->slot_generation[slot] + 1u) & SR_ID_GENERATION_MASK;
+    ctx->slot_body[slot] = -1;
+    ctx->body_slot[id] = -1;
+    ctx->free_slots[ctx->num_free_slots++] = slot;
+    ctx->free_bodies[ctx->num_free_bodies++] = id;
+
+    /* disabled bodies stay in the query index, queries skip them */
+    ctx->bodies[id].flags = SR_DISABLED;
+    ctx->bodies_tick_data[id].flags = 0;
+    ctx->bodies_tick_data[id].custom_flags = 0;
+    ctx->bodies_tick_data[id].children = 0;
+    sr_release_child_block(ctx, id);
+    if (ctx->features & SR_FEATURE_TREE) {
+        sr_tree_update_body(ctx, id);
+    }
+    if (ctx->options & SR_OPTION_SLEEP) {
+        sr_wake_around(ctx, ctx->bodies[id].r);
+    }
+
+    return 0;
+}
+
+/* Drops the removed bodies from the per body arrays, ids stay valid */
+
+void sr_context_compact(sr_Context *ctx) {
+    sr_Body_Id *map;
+    int i, count, sweep, leaf;
+
+    if (ctx->num_free_bodies == 0) {
+        return;
+    }
+
+    /* map holds the new index of each body, -1 for removed ones */
+    map = ctx->sort_ids;
+    count = 0;
+    for (i = 0; i < ctx->num_bodies; ++i) {
+        if (ctx->body_slot[i] < 0) {
+            map[i] = -1;
+            continue;
+        }
+
+        map[i] = count;
+        if (count != i) {
+            ctx->bodies[count] = ctx->bodies[i];
+            ctx->bodies_tick_data[count] = ctx->bodies_tick_data[i];
+            ctx->prev_min[count] = ctx->prev_min[i];
+            ctx->child_counts[count] = ctx->child_counts[i];
+            ctx->child_blocks[count] = ctx->child_blocks[i];
+            ctx->body_slot[count] = ctx->body_slot[i];
+            ctx->slot_body[ctx->body_slot[count]] = count;
+            if (ctx->features & SR_FEATURE_SLEEP) {
+                ctx->sleep_idle[count] = ctx->sleep_idle[i];
+            }
+        }
+
+        /* proxies of static index bodies can be stale, the static index is rebuilt below anyway */
+        if (ctx->features & SR_FEATURE_TREE) {
+            ctx->tree_proxy[count] = ctx->tree_proxy[i];
+            leaf = ctx->tree_proxy[count];
+            if (leaf != -1 && ctx->tree_nodes[leaf].body == i) {
+                ctx->tree_nodes[leaf].body = count;
+            }
+        }
+        ++count;
+    }
+
+    sweep = 0;
+    count = 0;
+    for (i = 0; i < ctx->num_bodies - ctx->num_free_dropped; ++i) {
+        if (map[ctx->bodies_sorted[i]] >= 0) {
+            sweep += i < ctx->num_sweep;
+            ctx->bodies_sorted[count++] = map[ctx->bodies_sorted[i]];
+        }
+    }
+    ctx->num_sweep = sweep;
+    ctx->num_bodies = count;
+
+    count = 0;
+    for (i = 0; i < ctx->num_query; ++i) {
+        if (map[ctx->query_ids[i]] >= 0) {
+            ctx->query_ids[count++] = map[ctx->query_ids[i]];
+        }
+    }
+    ctx->num_query = count;
+    ctx->query_dirty = 1;
+    sr_tree_mark_moved(ctx, -1);
+
+    ctx->num_free_bodies = 0;
+    ctx->num_free_dropped = 0;
+    ctx->num_sweep_saved = -1;
+    if (ctx->options & SR_OPTION_STATIC_INDEX) {
+        ctx->static_dirty = 1;
+    }
+}
+
+/* Drops the bodies removed since the last tick from bodies_sorted, so the sweep no longer carries them */
+void sr_drop_removed(sr_Context *ctx) {
+    int i, count, sweep;
+
+    if (ctx->num_free_dropped == ctx->num_free_bodies) {
+        return;
+    }
+
+    sweep = 0;
+    count = 0;
+    for (i = 0; i < ctx->num_bodies - ctx->num_free_dropped; ++i) {
+        if (ctx->body_slot[ctx->bodies_sorted[i]] >= 0) {
+            sweep += i < ctx->num_sweep;
+            ctx->bodies_sorted[count++] = ctx->bodies_sorted[i];
+        }
+    }
+    ctx->num_sweep = sweep;
+    ctx->num_free_dropped = ctx->num_free_bodies;
+    ctx->num_sweep_saved = -1;
+}
+
+#define SR_SNAPSHOT_SECTIONS 21
+
+void sr_snapshot_section(char **arrays_out, size_t *sizes_out, int *count, const void *array, size_t bytes) {
+    arrays_out[*count] = (char *)array;
+    sizes_out[*count] = bytes;
+    ++*count;
+}
+
+/* Writes the arrays of ctx a snapshot with the given header holds and their sizes, and returns how many there are */
+int sr_snapshot_sections(char **arrays_out, size_t *sizes_out, const sr_Context *ctx, const sr_Snapshot_Header *header) {
+    int n;
+
+    n = 0;
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->bodies, header->num_bodies * sizeof(sr_Body));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->bodies_sorted, header->num_bodies * sizeof(sr_Body_Id));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->bodies_tick_data, header->num_bodies * sizeof(sr_Body_Tick_Data));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->prev_min, header->num_bodies * sizeof(sr_Vec2));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->sleep_idle, (header->features & SR_FEATURE_SLEEP ? header->num_bodies : 0) * sizeof(int));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->tree_proxy, (header->features & SR_FEATURE_TREE ? header->num_bodies : 0) * sizeof(int));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->body_slot, header->num_bodies * sizeof(int));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->free_bodies, header->num_free_bodies * sizeof(int));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->slot_generation, header->num_slots * sizeof(unsigned int));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->slot_body, header->num_slots * sizeof(int));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->free_slots, header->num_free_slots * sizeof(int));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->sweep_saved, (header->num_sweep_saved > 0 ? header->num_sweep_saved : 0) * sizeof(sr_Body_Id));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->tree_nodes, header->num_tree_nodes * sizeof(sr_Tree_Node));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->contacts, header->num_contacts * sizeof(sr_Contact));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->contact_begins, header->num_contact_begins * sizeof(sr_Contact));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->contact_ends, header->num_contact_ends * sizeof(sr_Contact));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->tiles, header->num_tiles * sizeof(unsigned char));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->child_counts, header->num_bodies * sizeof(int));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->child_blocks, header->num_bodies * sizeof(int));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->child_rects, SR_CHILD_BLOCK * header->num_child_blocks * sizeof(sr_Rect));
+    sr_snapshot_section(arrays_out, sizes_out, &n, ctx->free_child_blocks, header->num_free_child_blocks * sizeof(int));
+
+    return n;
+}
+
+void sr_snapshot_header(sr_Snapshot_Header *header_out, const sr_Context *ctx) {
+    char *arrays[SR_SNAPSHOT_SECTIONS];
+    size_t sizes[SR_SNAPSHOT_SECTIONS];
+    int i, n;
+
+    memset(header_out, 0, sizeof(sr_Snapshot_Header));
+    header_out->num_bodies = ctx->num_bodies;
+    header_out->bodies_cap = ctx->bodies_cap;
+    header_out->num_sweep = ctx->num_sweep;
+    header_out->static_dirty = ctx->static_dirty;
+    header_out->num_sweep_saved = ctx->num_sweep_saved;
+    header_out->sweep_auto = ctx->sweep_auto;
+    header_out->features = ctx->features & ~SR_FEATURE_CONTACTS;
+    header_out->sweep_direction = ctx->sweep_direction;
+    header_out->sweep_variance[0] = ctx->sweep_variance[0];
+    header_out->sweep_variance[1] = ctx->sweep_variance[1];
+    header_out->tree_roots[SR_TREE_DYNAMIC] = ctx->tree_roots[SR_TREE_DYNAMIC];
+    header_out->tree_roots[SR_TREE_STATIC] = ctx->tree_roots[SR_TREE_STATIC];
+    header_out->tree_roots[SR_TREE_QUERY] = ctx->tree_roots[SR_TREE_QUERY];
+    header_out->tree_free = ctx->tree_free;
+    /* the node pool is only stored while a tree exists, an empty pool is rebuilt on restore */
+    header_out->num_tree_nodes = ctx->tree_roots[SR_TREE_DYNAMIC] != -1 || ctx->tree_roots[SR_TREE_STATIC] != -1 || ctx->tree_roots[SR_TREE_QUERY] != -1 ? 2 * ctx->bodies_cap : 0;
+    header_out->num_slots = ctx->num_slots;
+    header_out->num_free_slots = ctx->num_free_slots;
+    header_out->num_free_bodies = ctx->num_free_bodies;
+    header_out->num_free_dropped = ctx->num_free_dropped;
+    if (ctx->options & SR_OPTION_CONTACTS) {
+        header_out->num_contacts = ctx->num_contacts;
+        header_out->num_contact_begins = ctx->num_contact_begins;
+        header_out->num_contact_ends = ctx->num_contact_ends;
+    }
+    header_out->num_child_blocks = ctx->num_child_blocks;
+    header_out->num_free_child_blocks = ctx->num_free_child_blocks;
+    header_out->num_tiles = ctx->tiles_width * ctx->tiles_height;
+
+    header_out->bytes = sizeof(sr_Snapshot_Header);
+    n = sr_snapshot_sections(arrays, sizes, ctx, header_out);
+    for (i = 0; i < n; ++i) {
+        header_out->bytes += sizes[i];
+    }
+}
+
+/* Makes room in ctx for the state of header and takes over its counts, the tilemap must have the same size */
+int sr_snapshot_prepare(sr_Context *ctx, const sr_Snapshot_Header *header) {
+    int cap, num_contacts;
+
+    if (header->num_tiles != ctx->tiles_width * ctx->tiles_height) {
+        return -1;
+    }
+
+    cap = header->num_tree_nodes > 0 ? header->bodies_cap : header->num_bodies > header->num_slots ? header->num_bodies : header->num_slots;
+    if (cap > ctx->bodies_cap && sr_context_relayout(ctx, cap, ctx->features | header->features) != 0) {
+        return -1;
+    } else if (sr_context_set_features(ctx, ctx->features | header->features) != 0) {
+        return -1;
+    }
+
+    num_contacts = header->num_contacts > header->num_contact_begins ? header->num_contacts : header->num_contact_begins;
+    num_contacts = num_contacts > header->num_contact_ends ? num_contacts : header->num_contact_ends;
+    if (sr_reserve_contacts(ctx, num_contacts) != 0 || sr_reserve_child_blocks(ctx, header->num_child_blocks) != 0) {
+        return -1;
+    }
+
+    ctx->num_bodies = header->num_bodies;
+    ctx->num_sweep = header->num_sweep;
+    ctx->static_dirty = header->static_dirty;
+    ctx->num_sweep_saved = header->num_sweep_saved;
+    ctx->sweep_auto = header->sweep_auto;
+    ctx->sweep_direction = header->sweep_direction;
+    ctx->sweep_variance[0] = header->sweep_variance[0];
+    ctx->sweep_variance[1] = header->sweep_variance[1];
+    ctx->tree_roots[SR_TREE_DYNAMIC] = header->tree_roots[SR_TREE_DYNAMIC];
+    ctx->tree_roots[SR_TREE_STATIC] = header->tree_roots[SR_TREE_STATIC];
+    ctx->tree_roots[SR_TREE_QUERY] = header->tree_roots[SR_TREE_QUERY];
+    ctx->num_slots = header->num_slots;
+    ctx->num_free_slots = header->num_free_slots;
+    ctx->num_free_bodies = header->num_free_bodies;
+    ctx->num_free_dropped = header->num_free_dropped;
+    ctx->num_contacts = header->num_contacts;
+    ctx->num_prev_contacts = 0;
+    ctx->num_contact_begins = header->num_contact_begins;
+    ctx->num_contact_ends = header->num_contact_ends;
+    ctx->num_child_blocks = header->num_child_blocks;
+    ctx->num_free_child_blocks = header->num_free_child_blocks;
+    ctx->tiles_dirty |= header->num_tiles > 0;
+    /* the query index keeps its order between rebuilds, start over from the restored bodies */
+    ctx->num_query = 0;
+    ctx->query_dirty = 1;
+
+    return 0;
+}
+
+/* Links the tree nodes the snapshot didn't hold into the free list, after its arrays were copied into ctx */
+void sr_snapshot_finish(sr_Context *ctx, const sr_Snapshot_Header *header) {
+    ctx->tree_free = header->num_tree_nodes > 0 ? header->tree_free : -1;
+    if (ctx->features & SR_FEATURE_TREE) {
+        sr_tree_free_nodes(ctx, header->num_tree_nodes, 2 * ctx->bodies_cap);
+        sr_tree_mark_moved(ctx, -1);
+    }
+    if (ctx->features & ~header->features & SR_FEATURE_TREE) {
+        memset(ctx->tree_proxy, -1, ctx->num_bodies * sizeof(int));
+    }
+    if (ctx->features & ~header->features & SR_FEATURE_SLEEP) {
+        memset(ctx->sleep_idle, 0, ctx->num_bodies * sizeof(int));
+    }
+}
+
+size_t sr_context_snapshot_size(const sr_Context *ctx) {
+    sr_Snapshot_Header header;
+
+    sr_snapshot_header(&header, ctx);
+
+    return header.bytes;
+}
+
+/* Returns -1 if the buffer is smaller than sr_context_snapshot_size() */
+int sr_context_save(void *snapshot_out, size_t bytes, const sr_Context *ctx) {
+    sr_Snapshot_Header header;
+    char *arrays[SR_SNAPSHOT_SECTIONS];
+    size_t sizes[SR_SNAPSHOT_SECTIONS];
+    char *out;
+    int i, n;
+
+    if (ctx == NULL || snapshot_out == NULL) {
+        return -1;
+    }
+
+    sr_snapshot_header(&header, ctx);
+    if (bytes < header.bytes) {
+        return -1;
+    }
+
+    out = snapshot_out;
+    memcpy(out, &header, sizeof(sr_Snapshot_Header));
+    out += sizeof(sr_Snapshot_Header);
+
+    n = sr_snapshot_sections(arrays, sizes, ctx, &header);
+    for (i = 0; i < n; ++i) {
+        if (sizes[i] > 0) {
+            memcpy(out, arrays[i], sizes[i]);
+            out += sizes[i];
+        }
+    }
+
+    return 0;
+}
+
+/* Returns -1 if snapshot is a delta or ctx can't grow to hold it, ctx is unchanged in the second case */
+int sr_context_restore(sr_Context *ctx, const void *snapshot) {
+    sr_Snapshot_Header header;
+    char *arrays[SR_SNAPSHOT_SECTIONS];
+    size_t sizes[SR_SNAPSHOT_SECTIONS];
+    const char *in;
+    int i, n;
+
+    if (ctx == NULL || snapshot == NULL) {
+        return -1;
+    }
+
+    memcpy(&header, snapshot, sizeof(sr_Snapshot_Header));
+    if (header.is_delta || sr_snapshot_prepare(ctx, &header) != 0) {
+        return -1;
+    }
+
+    in = (const char *)snapshot + sizeof(sr_Snapshot_Header);
+    n = sr_snapshot_sections(arrays, sizes, ctx, &header);
+    for (i = 0; i < n; ++i) {
+        if (sizes[i] > 0) {
+            memcpy(arrays[i], in, sizes[i]);
+            in += sizes[i];
+        }
+    }
+    sr_snapshot_finish(ctx, &header);
+
+    return 0;
+}
+
+/* Saves the SR_SNAPSHOT_CHUNK byte pieces of ctx that differ from the full snapshot base. Returns -1 if they don't
+ * fit or base is a delta. */
+
+int sr_context_save_delta(void *delta_out, size_t bytes, const sr_Context *ctx, const void *base) {
+    sr_Snapshot_Header header, base_header;
+    char *arrays[SR_SNAPSHOT_SECTIONS], *base_arrays[SR_SNAPSHOT_SECTIONS];
+    size_t sizes[SR_SNAPSHOT_SECTIONS], base_sizes[SR_SNAPSHOT_SECTIONS];
+    size_t at, count_at, offset, len;
+    const char *base_in;
+    char *out;
+    int i, n, count, chunk;
+
+    if (ctx == NULL || delta_out == NULL || base == NULL || bytes < sizeof(sr_Snapshot_Header)) {
+        return -1;
+    }
+
+    memcpy(&base_header, base, sizeof(sr_Snapshot_Header));
+    if (base_header.is_delta) {
+        return -1;
+    }
+
+    sr_snapshot_header(&header, ctx);
+    header.is_delta = 1;
+    n = sr_snapshot_sections(arrays, sizes, ctx, &header);
+    sr_snapshot_sections(base_arrays, base_sizes, ctx, &base_header);
+
+    out = delta_out;
+    at = sizeof(sr_Snapshot_Header);
+    base_in = (const char *)base + sizeof(sr_Snapshot_Header);
+
+    for (i = 0; i < n; ++i) {
+        count_at = at;
+        at += sizeof(int);
+        if (at > bytes) {
+            return -1;
+        }
+
+        if (sizes[i] != base_sizes[i]) {
+            /* -1 marks an array stored whole */
+            count = -1;
+            if (at + sizes[i] > bytes) {
+                return -1;
+            } else if (sizes[i] > 0) {
+                memcpy(out + at, arrays[i], sizes[i]);
+                at += sizes[i];
+            }
+        } else {
+            count = 0;
+            for (chunk = 0, offset = 0; offset < sizes[i]; ++chunk, offset += SR_SNAPSHOT_CHUNK) {
+                len = sizes[i] - offset < SR_SNAPSHOT_CHUNK ? sizes[i] - offset : SR_SNAPSHOT_CHUNK;
+                if (memcmp(arrays[i] + offset, base_in + offset, len) == 0) {
+                    continue;
+                } else if (at + sizeof(int) + len > bytes) {
+                    return -1;
+                }
+                memcpy(out + at, &chunk, sizeof(int));
+                memcpy(out + at + sizeof(int), arrays[i] + offset, len);
+                at += sizeof(int) + len;
+                ++count;
+            }
+        }
+
+        memcpy(out + count_at, &count, sizeof(int));
+        base_in += base_sizes[i];
+    }
+
+    header.bytes = at;
+    memcpy(out, &header, sizeof(sr_Snapshot_Header));
+
+    return 0;
+}
+
+/* Restores the state delta was saved with, base must be the snapshot the delta was made against */
+int sr_context_restore_delta(sr_Context *ctx, const void *base, const void *delta) {
+    sr_Snapshot_Header header;
+    char *arrays[SR_SNAPSHOT_SECTIONS];
+    size_t sizes[SR_SNAPSHOT_SECTIONS];
+    size_t offset, len;
+    const char *in;
+    int i, k, n, count, chunk;
+
+    if (delta == NULL) {
+        return -1;
+    }
+
+    memcpy(&header, delta, sizeof(sr_Snapshot_Header));
+    if (!header.is_delta || sr_context_restore(ctx, base) != 0 || sr_snapshot_prepare(ctx, &header) != 0) {
+        return -1;
+    }
+
+    in = (const char *)delta + sizeof(sr_Snapshot_Header);
+    n = sr_snapshot_sections(arrays, sizes, ctx, &header);
+    for (i = 0; i < n; ++i) {
+        memcpy(&count, in, sizeof(int));
+        in += sizeof(int);
+
+        if (count < 0) {
+            if (sizes[i] > 0) {
+                memcpy(arrays[i], in, sizes[i]);
+                in += sizes[i];
+            }
+            continue;
+        }
+
+        for (k = 0; k < count; ++k) {
+            memcpy(&chunk, in, sizeof(int));
+            offset = (size_t)chunk * SR_SNAPSHOT_CHUNK;
+            len = sizes[i] - offset < SR_SNAPSHOT_CHUNK ? sizes[i] - offset : SR_SNAPSHOT_CHUNK;
+            memcpy(arrays[i] + offset, in + sizeof(int), len);
+            in += sizeof(int) + len;
+        }
+    }
+    sr_snapshot_finish(ctx, &header);
+
+    return 0;
+}
+
+/* The bytes a snapshot or delta actually uses */
+size_t sr_snapshot_bytes(const void *snapshot) {
+    sr_Snapshot_Header header;
+
+    memcpy(&header, snapshot, sizeof(sr_Snapshot_Header));
+
+    return header.bytes;
+}
+
+/* A ray in the sweep (x) and cross (y) coordinates of the query index, inv holds 1 / d for the non-zero components */
+typedef struct {
+    sr_Vec2 o, d, inv;
+    sr_Scalar max_t;
+} sr_Ray;
+
+/* The sweep coordinate of the ray at t, without the 0 * inf of a ray along the cross axis with an unbounded max_t */
+sr_Scalar sr_ray_sweep_at(const sr_Ray *ray, sr_Scalar t) {
+    sr_Scalar step;
+
+    if (ray->d.x == 0) {
+        return ray->o.x;
+    }
+
+    step = sr_mul(ray->d.x, t);
+#ifdef SR_FIXED
+    /* an unbounded max_t saturates the product, the sum must not wrap around */
+    if (step > 0 && ray->o.x > SR_SCALAR_MAX - step) {
+        return SR_SCALAR_MAX;
+    } else if (step < 0 && ray->o.x < -SR_SCALAR_MAX - step) {
+        return -SR_SCALAR_MAX;
+    }
+#endif
+
+    return ray->o.x + step;
+}
+
+/* The t at which the ray has moved delta along axis 0 (sweep) or 1 (cross), fixed point divides for the precision */
+sr_Scalar sr_ray_param(const sr_Ray *ray, int axis, sr_Scalar delta) {
+#ifdef SR_FIXED
+    return sr_div(delta, axis == 0 ? ray->d.x : ray->d.y);
+#else
+    return delta * (axis == 0 ? ray->inv.x : ray->inv.y);
+#endif
+}
+
+void sr_ray_init(sr_Ray *ray, const sr_Context *ctx, sr_Vec2 origin, sr_Vec2 dir, sr_Scalar max_t) {
+    if (ctx->sweep_direction == SR_SWEEP_X) {
+        ray->o = origin;
+        ray->d = dir;
+    } else {
+        ray->o.x = origin.y;
+        ray->o.y = origin.x;
+        ray->d.x = dir.y;
+        ray->d.y = dir.x;
+    }
+    ray->inv.x = ray->d.x != 0 ? sr_div(SR_SCALAR(1), ray->d.x) : 0;
+    ray->inv.y = ray->d.y != 0 ? sr_div(SR_SCALAR(1), ray->d.y) : 0;
+    ray->max_t = max_t;
+}
+
+/* Turns rect into the sweep (x) and cross (y) coordinates of the ray */
+sr_Rect sr_ray_local_rect(const sr_Context *ctx, sr_Rect rect) {
+    sr_Rect local;
+
+    if (ctx->sweep_direction == SR_SWEEP_X) {
+        return rect;
+    }
+    local.min.x = rect.min.y;
+    local.min.y = rect.min.x;
+    local.max.x = rect.max.y;
+    local.max.y = rect.max.x;
+
+    return local;
+}
+
+/* The rect at sorted position k of the query index in the coordinates of the ray */
+sr_Rect sr_ray_index_rect(const sr_Context *ctx, int k) {
+    sr_Rect r;
+
+    r.min.x = ctx->query_sweep_min[k];
+    r.min.y = ctx->query_cross_min[k];
+    r.max.x = ctx->query_sweep_max[k];
+    r.max.y = ctx->query_cross_max[k];
+
+    return r;
+}
+
+/* Slab test of the ray against r, stores the entry t and axis (0 sweep, 1 cross, -1 inside) on a hit */
+int sr_ray_rect(const sr_Ray *ray, sr_Rect r, sr_Scalar *t_out, int *axis_out) {
+    sr_Scalar lo, hi, t0, t1, temp;
+    int axis;
+
+    lo = 0;
+    hi = ray->max_t;
+    axis = -1;
+
+    if (ray->d.x != 0) {
+        t0 = sr_ray_param(ray, 0, r.min.x - ray->o.x);
+        t1 = sr_ray_param(ray, 0, r.max.x - ray->o.x);
+        if (t0 > t1) {
+            temp = t0;
+            t0 = t1;
+            t1 = temp;
+        }
+        if (t0 > lo) {
+            lo = t0;
+            axis = 0;
+        }
+        hi = t1 < hi ? t1 : hi;
+    } else if (ray->o.x < r.min.x || ray->o.x > r.max.x) {
+        return 0;
+    }
+
+    if (ray->d.y != 0) {
+        t0 = sr_ray_param(ray, 1, r.min.y - ray->o.y);
+        t1 = sr_ray_param(ray, 1, r.max.y - ray->o.y);
+        if (t0 > t1) {
+            temp = t0;
+            t0 = t1;
+            t1 = temp;
+        }
+        if (t0 > lo) {
+            lo = t0;
+            axis = 1;
+        }
+        hi = t1 < hi ? t1 : hi;
+    } else if (ray->o.y < r.min.y || ray->o.y > r.max.y) {
+        return 0;
+    }
+
+    if (lo > hi) {
+        return 0;
+    }
+
+    *t_out = lo;
+    *axis_out = axis;
+
+    return 1;
+}
+
+void sr_fill_hit(sr_Raycast_Hit *hit, const sr_Context *ctx, const sr_Ray *ray, sr_Body_Id id, sr_Scalar t, int axis) {
+    sr_Vec2 normal;
+
+    normal.x = axis == 0 ? (ray->d.x > 0 ? -SR_SCALAR(1) : SR_SCALAR(1)) : 0;
+    normal.y = axis == 1 ? (ray->d.y > 0 ? -SR_SCALAR(1) : SR_SCALAR(1)) : 0;
+
+    hit->id = sr_body_handle(ctx, id);
+    hit->t = t;
+    if (ctx->sweep_direction == SR_SWEEP_X) {
+        hit->point.x = ray->o.x + sr_mul(ray->d.x, t);
+        hit->point.y = ray->o.y + sr_mul(ray->d.y, t);
+        hit->normal = normal;
+    } else {
+        hit->point.x = ray->o.y + sr_mul(ray->d.y, t);
+        hit->point.y = ray->o.x + sr_mul(ray->d.x, t);
+        hit->normal.x = normal.y;
+        hit->normal.y = normal.x;
+    }
+}
+
+/* Keeps the max_hits nearest of the count hits so far sorted by t, equal t in the order they were found */
+void sr_keep_hit(sr_Raycast_Hit *hits_out, int max_hits, int count, const sr_Context *ctx, const sr_Ray *ray, sr_Body_Id id, sr_Scalar t, int axis) {
+    sr_Raycast_Hit hit;
+    int j;
+
+    if (max_hits == 0 || (count > max_hits && hits_out[max_hits - 1].t <= t)) {
+        return;
+    }
+    sr_fill_hit(&hit, ctx, ray, id, t, axis);
+    j = count <= max_hits ? count - 1 : max_hits - 1;
+    while (j > 0 && hits_out[j - 1].t > t) {
+        hits_out[j] = hits_out[j - 1];
+        --j;
+    }
+    hits_out[j] = hit;
+}
+
+/* sr_raycast_all() for the tree broadphase, or the nearest hit only if nearest is set. Returns the number of hits. */
+int sr_tree_raycast(sr_Raycast_Hit *hits_out, int max_hits, const sr_Context *ctx, sr_Ray *ray, unsigned int filter, int nearest) {
+    const sr_Tree_Node *n;
+    int stack[SR_TREE_STACK_SIZE];
+    sr_Scalar t;
+    int tree, top, axis, count;
+
+    count = 0;
+    for (tree = SR_TREE_DYNAMIC; tree <= SR_TREE_QUERY; ++tree) {
+        top = 0;
+        if (ctx->tree_roots[tree] != -1) {
+            stack[top++] = ctx->tree_roots[tree];
+        }
+
+        while (top > 0) {
+            n = &(ctx->tree_nodes[stack[--top]]);
+            if (!sr_ray_rect(ray, sr_ray_local_rect(ctx, n->aabb), &t, &axis)) {
+                continue;
+            } else if (n->child1 != -1) {
+                SR_ASSERT(top + 2 <= SR_TREE_STACK_SIZE && "tree too deep for SR_TREE_STACK_SIZE");
+                stack[top++] = n->child2;
+                stack[top++] = n->child1;
+            } else if (!sr_ray_rect(ray, sr_ray_local_rect(ctx, ctx->bodies[n->body].r), &t, &axis) || !sr_query_accepts(ctx, n->body, filter)) {
+                continue;
+            } else if (!nearest) {
+                ++count;
+                sr_keep_hit(hits_out, max_hits, count, ctx, ray, n->body, t, axis);
+            } else if (count == 0 || t < ray->max_t) {
+                sr_fill_hit(hits_out, ctx, ray, n->body, t, axis);
+                ray->max_t = t;
+                count = 1;
+            }
+        }
+    }
+
+    return count;
+}
+
+/* Walks the positions [first, end) in the ray's direction until no body can be hit before the nearest hit */
+
+int sr_raycast(sr_Raycast_Hit *hit_out, sr_Context *ctx, sr_Vec2 origin, sr_Vec2 dir, sr_Scalar max_t, unsigned int filter) {
+    sr_Ray ray;
+    sr_Scalar t, s_end;
+    int k, first, end, axis, found;
+
+    sr_update_query_index(ctx);
+    sr_ray_init(&ray, ctx, origin, dir, max_t);
+    if (ctx->sweep_direction == SR_BROADPHASE_TREE) {
+        return sr_tree_raycast(hit_out, 1, ctx, &ray, filter, 1);
+    }
+
+    s_end = sr_ray_sweep_at(&ray, max_t);
+    first = sr_query_first(ctx, ray.d.x < 0 ? s_end : ray.o.x);
+    end = sr_query_end(ctx, ray.d.x < 0 ? ray.o.x : s_end);
+    found = 0;
+
+    if (ray.d.x >= 0) {
+        for (k = first; k < end && ctx->query_sweep_min[k] <= sr_ray_sweep_at(&ray, ray.max_t); ++k) {
+            if (sr_ray_rect(&ray, sr_ray_index_rect(ctx, k), &t, &axis) && (!found || t < ray.max_t) && sr_query_accepts(ctx, ctx->query_ids[k], filter)) {
+                sr_fill_hit(hit_out, ctx, &ray, ctx->query_ids[k], t, axis);
+                ray.max_t = t;
+                found = 1;
+            }
+        }
+    } else {
+        for (k = end - 1; k >= first && ctx->query_reach[k] >= sr_ray_sweep_at(&ray, ray.max_t); --k) {
+            if (sr_ray_rect(&ray, sr_ray_index_rect(ctx, k), &t, &axis) && (!found || t < ray.max_t) && sr_query_accepts(ctx, ctx->query_ids[k], filter)) {
+                sr_fill_hit(hit_out, ctx, &ray, ctx->query_ids[k], t, axis);
+                ray.max_t = t;
+                found = 1;
+            }
+        }
+    }
+
+    return found;
+}
+
+int sr_raycast_all(sr_Raycast_Hit *hits_out, int max_hits, sr_Context *ctx, sr_Vec2 origin, sr_Vec2 dir, sr_Scalar max_t, unsigned int filter) {
+    sr_Ray ray;
+    sr_Scalar t, s_end;
+    int k, first, end, axis, count;
+
+    if (max_hits < 0) {
+        return -1;
+    }
+
+    sr_update_query_index(ctx);
+    sr_ray_init(&ray, ctx, origin, dir, max_t);
+    if (ctx->sweep_direction == SR_BROADPHASE_TREE) {
+        return sr_tree_raycast(hits_out, max_hits, ctx, &ray, filter, 0);
+    }
+
+    s_end = sr_ray_sweep_at(&ray, max_t);
+    first = sr_query_first(ctx, ray.d.x < 0 ? s_end : ray.o.x);
+    end = sr_query_end(ctx, ray.d.x < 0 ? ray.o.x : s_end);
+    count = 0;
+
+    for (k = first; k < end; ++k) {
+        if (sr_ray_rect(&ray, sr_ray_index_rect(ctx, k), &t, &axis) && sr_query_accepts(ctx, ctx->query_ids[k], filter)) {
+            ++count;
+            sr_keep_hit(hits_out, max_hits, count, ctx, &ray, ctx->query_ids[k], t, axis);
+        }
+    }
+
+    return count;
+}
+
+void sr_sweep_loop(sr_Context *ctx) {
+    unsigned int skip;
+    int i, j;
+
+    for (i = 0; i < ctx->num_sweep; ++i) {
+        if (ctx->hot_flags[i] & (SR_DISABLED | SR_NO_COLLISION)) {
+            continue;
+        }
+        /* a sleeping body only pairs with awake ones */
+        skip = SR_DISABLED | SR_NO_COLLISION | (ctx->hot_flags[i] & SR_ASLEEP);
+        for (j = i + 1; j < ctx->num_sweep; ++j) {
+#ifdef SR_SIMD_WIDTH
+            j = sr_sweep_skip_simd(ctx, i, j, skip);
+            if (j >= ctx->num_sweep) {
+                break;
+            }
+#endif
+            if (ctx->hot_sweep_min[j] > ctx->hot_sweep_max[i]) {
+                break;
+            } else if (ctx->hot_flags[j] & skip || !sr_do_hot_layers_match(ctx, i, j)) {
+                continue;
+            } else if (sr_do_hot_overlap(ctx, i, j)) {
+                sr_resolve_bodies(ctx, ctx->bodies_sorted[i], ctx->bodies_sorted[j]);
+                sr_store_hot(ctx, i);
+                sr_store_hot(ctx, j);
+            }
+        }
+        SR_STAT(ctx->stats.pairs_visited += j - i - 1;)
+    }
+}
+
+int sr_push_pair(sr_Pair_Chunk *chunk, sr_Body_Id id1, sr_Body_Id id2, int pos1, int pos2) {
+    if (chunk->num_pairs >= chunk->pairs_cap) {
+        return -1;
+    } else {
+        chunk->pairs[chunk->num_pairs].id1 = id1;
+        chunk->pairs[chunk->num_pairs].id2 = id2;
+        chunk->pairs[chunk->num_pairs].pos1 = pos1;
+        chunk->pairs[chunk->num_pairs].pos2 = pos2;
+        ++chunk->num_pairs;
+
+        return 0;
+    }
+}
+
+/* Same as one iteration of sr_sweep_loop() on the rects the tick started with, but only records the pairs */
+int sr_sweep_find_pairs(const sr_Context *ctx, int i, sr_Pair_Chunk *chunk) {
+    unsigned int skip;
+    int j;
+
+    if (ctx->hot_flags[i] & (SR_DISABLED | SR_NO_COLLISION)) {
+        return 0;
+    }
+
+    skip = SR_DISABLED | SR_NO_COLLISION | (ctx->hot_flags[i] & SR_ASLEEP);
+    for (j = i + 1; j < ctx->num_sweep; ++j) {
+#ifdef SR_SIMD_WIDTH
+        j = sr_sweep_skip_simd(ctx, i, j, skip);
+        if (j >= ctx->num_sweep) {
+            break;
+        }
+#endif
+        if (ctx->hot_sweep_min[j] > ctx->hot_sweep_max[i]) {
+            break;
+        } else if (ctx->hot_flags[j] & skip || !sr_do_hot_layers_match(ctx, i, j)) {
+            continue;
+        } else if (sr_do_hot_overlap(ctx, i, j)) {
+            if (sr_push_pair(chunk, ctx->bodies_sorted[i], ctx->bodies_sorted[j], i, j) != 0) {
+                return -1;
+            }
+        }
+    }
+    SR_STAT(chunk->pairs_visited += j - i - 1;)
+
+    return 0;
+}
+
+/* Records the pairs of body id with the static index, in the order sr_resolve_static_index() would resolve them */
+int sr_static_find_pairs(const sr_Context *ctx, sr_Body_Id id, sr_Pair_Chunk *chunk) {
+    const sr_Tree_Node *n;
+    int stack[SR_TREE_STACK_SIZE];
+    int top;
+    SR_STAT(long visited = 0;)
+
+    if (ctx->bodies[id].flags & (SR_DISABLED | SR_NO_COLLISION) || ctx->tree_roots[SR_TREE_STATIC] == -1) {
+        return 0;
+    }
+
+    top = 0;
+    stack[top++] = ctx->tree_roots[SR_TREE_STATIC];
+
+    while (top > 0) {
+        n = &(ctx->tree_nodes[stack[--top]]);
+
+        if (!sr_do_rects_overlap(n->aabb, ctx->bodies[id].r)) {
+            continue;
+        } else if (n->child1 != -1) {
+            SR_ASSERT(top + 2 <= SR_TREE_STACK_SIZE && "tree too deep for SR_TREE_STACK_SIZE");
+            stack[top++] = n->child2;
+            stack[top++] = n->child1;
+        } else if (!(ctx->bodies[n->body].flags & (SR_DISABLED | SR_NO_COLLISION)) && sr_do_layers_match(ctx, id, n->body) && !sr_is_pair_asleep(ctx, id, n->body)) {
+            SR_STAT(++visited;)
+            if (sr_push_pair(chunk, id < n->body ? id : n->body, id < n->body ? n->body : id, -1, -1) != 0) {
+                return -1;
+            }
+        }
+    }
+    SR_STAT(chunk->pairs_visited += visited;)
+
+    return 0;
+}
+
+#define SR_STAGE_SWEEP 0
+#define SR_STAGE_STATIC 1
+
+void sr_find_pairs_task(void *task_data, int index) {
+    sr_Context *ctx;
+    sr_Pair_Chunk *chunk;
+    int i, mark, failed;
+
+    ctx = task_data;
+    chunk = &(ctx->chunks[index]);
+
+    for (i = chunk->next; i < chunk->end; ++i) {
+        mark = chunk->num_pairs;
+
+        if (ctx->parallel_stage == SR_STAGE_SWEEP) {
+            failed = sr_sweep_find_pairs(ctx, i, chunk);
+        } else {
+            failed = sr_static_find_pairs(ctx, ctx->bodies_sorted[i], chunk);
+        }
+
+        if (failed) {
+            /* drop the partial pairs of i, it is redone once the buffer has grown */
+            chunk->num_pairs = mark;
+            break;
+        }
+    }
+
+    chunk->next = i;
+}
+
+/* Finds the pairs of the sorted positions [0, count) in one chunk per task, in sweep order. Returns -1 if a
+ * buffer could not grow. */
+
+int sr_parallel_find_pairs(sr_Context *ctx, int stage, int count) {
+    void *realloc_out;
+    int i, new_cap, incomplete;
+
+    ctx->parallel_stage = stage;
+
+    for (i = 0; i < ctx->num_chunks; ++i) {
+        ctx->chunks[i].num_pairs = 0;
+        ctx->chunks[i].begin = (int)((long)count * i / ctx->num_chunks);
+        ctx->chunks[i].end = (int)((long)count * (i + 1) / ctx->num_chunks);
+        ctx->chunks[i].next = ctx->chunks[i].begin;
+        ctx->chunks[i].diverged = 0;
+        SR_STAT(ctx->chunks[i].pairs_visited = 0;)
+        SR_STAT(ctx->chunks[i].pairs_overlapping = 0;)
+        SR_STAT(ctx->chunks[i].pairs_static = 0;)
+    }
+
+    do {
+        ctx->parallel_for(ctx->parallel_user, sr_find_pairs_task, ctx, ctx->num_chunks);
+
+        incomplete = 0;
+        for (i = 0; i < ctx->num_chunks; ++i) {
+            if (ctx->chunks[i].next < ctx->chunks[i].end) {
+                new_cap = ctx->chunks[i].pairs_cap < 32 ? 64 : ctx->chunks[i].pairs_cap * 2;
+                realloc_out = SR_REALLOC(SR_ALLOC_CONTEXT, ctx->chunks[i].pairs, new_cap * sizeof(sr_Pair));
+                if (realloc_out == NULL) {
+                    return -1;
+                }
+                ctx->chunks[i].pairs = realloc_out;
+                ctx->chunks[i].pairs_cap = new_cap;
+                incomplete = 1;
+            }
+        }
+    } while (incomplete);
+
+    return 0;
+}
+
+void sr_resolve_pair_chunks(sr_Context *ctx) {
+    const sr_Pair *pair;
+    int i, k;
+
+    for (i = 0; i < ctx->num_chunks; ++i) {
+        for (k = 0; k < ctx->chunks[i].num_pairs; ++k) {
+            pair = &(ctx->chunks[i].pairs[k]);
+            /* earlier resolutions may have pushed the bodies apart */
+            if (sr_do_rects_overlap(ctx->bodies[pair->id1].r, ctx->bodies[pair->id2].r)) {
+                sr_resolve_bodies(ctx, pair->id1, pair->id2);
+            }
+        }
+    }
+}
+
+#ifdef SR_STATS
+/* Adds the counters the tasks kept in their chunks to the tick stats */
+void sr_add_chunk_stats(sr_Context *ctx) {
+    int i;
+
+    for (i = 0; i < ctx->num_chunks; ++i) {
+        ctx->stats.pairs_visited += ctx->chunks[i].pairs_visited;
+        ctx->stats.pairs_overlapping += ctx->chunks[i].pairs_overlapping;
+        ctx->stats.pairs_static += ctx->chunks[i].pairs_static;
+    }
+}
+#endif
+
+int sr_island_find(sr_Context *ctx, int id) {
+    while (ctx->island_parent[id] != id) {
+        ctx->island_parent[id] = ctx->island_parent[ctx->island_parent[id]];
+        id = ctx->island_parent[id];
+    }
+
+    return id;
+}
+
+void sr_island_union(sr_Context *ctx, int id1, int id2) {
+    id1 = sr_island_find(ctx, id1);
+    id2 = sr_island_find(ctx, id2);
+
+    if (id1 < id2) {
+        ctx->island_parent[id2] = id1;
+    } else {
+        ctx->island_parent[id1] = id2;
+    }
+}
+
+/* The body of a pair that decides its island. Static bodies are never moved, so they do not join islands. */
+sr_Body_Id sr_island_body(const sr_Context *ctx, const sr_Pair *pair) {
+    return ctx->bodies[pair->id1].priority == SR_PRIORITY_STATIC ? pair->id2 : pair->id1;
+}
+
+int sr_island_start(const sr_Context *ctx, int island) {
+    return island == 0 ? 0 : ctx->island_ends[island - 1];
+}
+
+/* The task that owns an island: the one whose share of the pairs holds the island's first pair */
+int sr_island_task(const sr_Context *ctx, int island) {
+    return (int)((long)sr_island_start(ctx, island) * ctx->num_chunks / ctx->num_island_pairs);
+}
+
+void sr_resolve_islands_task(void *task_data, int index) {
+    sr_Context *ctx;
+    sr_Island_Pair *pair;
+    int island, lo, hi, mid, k;
+
+    ctx = task_data;
+
+    lo = 0;
+    hi = ctx->num_islands;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (sr_island_task(ctx, mid) < index) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (island = lo; island < ctx->num_islands && sr_island_task(ctx, island) == index; ++island) {
+        for (k = sr_island_start(ctx, island); k < ctx->island_ends[island]; ++k) {
+            pair = &(ctx->island_pairs[k]);
+            if (ctx->options & SR_OPTION_SLEEP) {
+                pair->idle1 = ctx->sleep_idle[pair->id1];
+                pair->idle2 = ctx->sleep_idle[pair->id2];
+            }
+
+            /* static bodies are shared between islands, so all tick flags are applied after the join */
+            pair->overlapped = sr_do_rects_overlap(ctx->bodies[pair->id1].r, ctx->bodies[pair->id2].r);
+            if (pair->overlapped) {
+                sr_resolve_bodies_into(ctx, pair->id1, pair->id2, &(pair->t1), &(pair->t2), ctx->options & SR_OPTION_CONTACTS ? &(pair->contact) : NULL);
+                SR_STAT(sr_count_pair(ctx, pair->id1, pair->id2, &(ctx->chunks[index].pairs_overlapping), &(ctx->chunks[index].pairs_static));)
+            }
+
+            if (ctx->options & SR_OPTION_SLEEP) {
+                pair->woke = (pair->idle1 > 1 && ctx->sleep_idle[pair->id1] == 1) | (pair->idle2 > 1 && ctx->sleep_idle[pair->id2] == 1) << 1;
+            } else {
+                pair->woke = 0;
+            }
+            pair->r1 = ctx->bodies[pair->id1].r;
+            pair->r2 = ctx->bodies[pair->id2].r;
+        }
+    }
+}
+
+sr_Rect sr_hot_rect(const sr_Context *ctx, int ind) {
+    sr_Rect r;
+
+    if (ctx->sweep_direction == SR_SWEEP_X) {
+        r.min.x = ctx->hot_sweep_min[ind];
+        r.max.x = ctx->hot_sweep_max[ind];
+        r.min.y = ctx->hot_cross_min[ind];
+        r.max.y = ctx->hot_cross_max[ind];
+    } else {
+        r.min.y = ctx->hot_sweep_min[ind];
+        r.max.y = ctx->hot_sweep_max[ind];
+        r.min.x = ctx->hot_cross_min[ind];
+        r.max.x = ctx->hot_cross_max[ind];
+    }
+
+    return r;
+}
+
+/* r with x and y swapped when sweeping along y */
+sr_Rect sr_sweep_axis_rect(const sr_Context *ctx, sr_Rect r) {
+    sr_Rect s;
+
+    if (ctx->sweep_direction == SR_SWEEP_X) {
+        return r;
+    }
+    s.min.x = r.min.y;
+    s.min.y = r.min.x;
+    s.max.x = r.max.y;
+    s.max.y = r.max.x;
+
+    return s;
+}
+
+/* Points *r at the rect the islands left body id with before the pairs of sorted position i, and returns the first
+ * pair of id from there on, or -1 */
+int sr_island_rect_at(sr_Rect *r, const sr_Context *ctx, sr_Body_Id id, int i) {
+    const sr_Island_Pair *pair;
+    int k;
+
+    k = ctx->island_heads[id];
+    while (k != -1 && ctx->island_pairs[k].pos1 < i) {
+        pair = &(ctx->island_pairs[k]);
+        *r = pair->id1 == id ? pair->r1 : pair->r2;
+        k = pair->id1 == id ? pair->next1 : pair->next2;
+    }
+
+    return k;
+}
+
+/* Points the cursor of sorted position j at its first pair */
+void sr_island_cursor_reset(sr_Context *ctx, int j) {
+    if (ctx->island_paired[j / 32] >> (j % 32) & 1u) {
+        ctx->island_cursors[j] = ctx->island_heads[ctx->bodies_sorted[j]];
+        ctx->island_cursor_rows[j] = ctx->island_first_rows[j];
+    } else {
+        ctx->island_cursors[j] = -1;
+        ctx->island_cursor_rows[j] = ctx->num_sweep;
+    }
+    ctx->island_cursor_rects[j] = sr_hot_rect(ctx, j);
+}
+
+/* Same as sr_island_rect_at() for sorted position j, but moves its cursor on from the last i, which may not go back
+ * until the cursor is reset. The rect is left in island_cursor_rects. */
+int sr_island_cursor_at(sr_Context *ctx, int j, int i) {
+    const sr_Island_Pair *pair;
+    sr_Body_Id id;
+    int k;
+
+    if (ctx->island_cursor_rows[j] >= i) {
+        return ctx->island_cursors[j];
+    }
+
+    id = ctx->bodies_sorted[j];
+    k = ctx->island_cursors[j];
+    while (k != -1 && ctx->island_pairs[k].pos1 < i) {
+        pair = &(ctx->island_pairs[k]);
+        ctx->island_cursor_rects[j] = pair->id1 == id ? pair->r1 : pair->r2;
+        k = pair->id1 == id ? pair->next1 : pair->next2;
+    }
+    ctx->island_cursors[j] = k;
+    ctx->island_cursor_rows[j] = k != -1 ? ctx->island_pairs[k].pos1 : ctx->num_sweep;
+
+    return k;
+}
+
+sr_Rect sr_island_rect_now(sr_Context *ctx, int j, int i) {
+    sr_island_cursor_at(ctx, j, i);
+    return ctx->island_cursor_rects[j];
+}
+
+/* The rect of the body at sorted position j when the sweep gets to position i, taking it from island_rects once the
+ * sweep resolved it itself */
+sr_Rect sr_sweep_rect_at(sr_Context *ctx, int j, int i) {
+    if (ctx->island_dirty[j / 32] >> (j % 32) & 1u) {
+        return ctx->island_rects[j];
+    }
+
+    return sr_island_rect_now(ctx, j, i);
+}
+
+/* Replays sr_sweep_loop() for a chunk on the islands' rects, island_row_ends gets where each position stopped,
+ * or -1 minus that if the islands resolved it differently */
+void sr_check_islands_task(void *task_data, int index) {
+    sr_Context *ctx;
+    sr_Pair_Chunk *chunk;
+    const sr_Island_Pair *pair;
+    sr_Rect ri, rj;
+    unsigned int skip;
+    int i, j, k, overlap, differs, moved;
+
+    ctx = task_data;
+    chunk = &(ctx->chunks[index]);
+    SR_STAT(chunk->pairs_visited = 0;)
+
+    for (i = chunk->begin; i < chunk->end; ++i) {
+        sr_island_cursor_reset(ctx, i);
+    }
+
+    for (i = chunk->begin; i < chunk->end; ++i) {
+        ctx->island_row_ends[i] = i;
+        if (ctx->hot_flags[i] & (SR_DISABLED | SR_NO_COLLISION)) {
+            continue;
+        }
+
+        /* rects are kept with the sweep axis in x, so that bodies without pairs compare against the hot arrays */
+        skip = SR_DISABLED | SR_NO_COLLISION | (ctx->hot_flags[i] & SR_ASLEEP);
+        k = sr_island_cursor_at(ctx, i, i);
+        ri = sr_sweep_axis_rect(ctx, ctx->island_cursor_rects[i]);
+        moved = ctx->island_paired[i / 32] >> (i % 32) & 1u && ctx->island_first_rows[i] < i;
+        differs = 0;
+
+        for (j = i + 1; j < ctx->num_sweep; ++j) {
+            /* a body without pairs can only overlap i once i moved, as the pairs were found on the same rects */
+            if (!(ctx->island_paired[j / 32] >> (j % 32) & 1u)) {
+                if (ctx->hot_sweep_min[j] > ri.max.x) {
+                    break;
+                } else if (!moved || ctx->hot_flags[j] & skip || !sr_do_hot_layers_match(ctx, i, j)) {
+                    continue;
+                }
+                differs |= !(ri.min.x > ctx->hot_sweep_max[j] || ri.min.y > ctx->hot_cross_max[j] || ri.max.y < ctx->hot_cross_min[j]);
+                continue;
+            }
+
+            /* positions past the chunk belong to the cursors of another task */
+            if (j < chunk->end) {
+                if (ctx->island_cursor_rows[j] < i) {
+                    sr_island_cursor_at(ctx, j, i);
+                }
+                rj = ctx->island_cursor_rects[j];
+            } else {
+                rj = sr_hot_rect(ctx, j);
+                sr_island_rect_at(&rj, ctx, ctx->bodies_sorted[j], i);
+            }
+            rj = sr_sweep_axis_rect(ctx, rj);
+
+            if (rj.min.x > ri.max.x) {
+                break;
+            } else if (ctx->hot_flags[j] & skip || !sr_do_hot_layers_match(ctx, i, j)) {
+                continue;
+            }
+
+            overlap = sr_do_rects_overlap(ri, rj);
+            if (k != -1 && ctx->island_pairs[k].pos2 == j) {
+                pair = &(ctx->island_pairs[k]);
+                differs |= pair->overlapped != overlap;
+                ri = sr_sweep_axis_rect(ctx, pair->r1);
+                k = pair->next1;
+                moved = 1;
+            } else {
+                differs |= overlap;
+            }
+        }
+        SR_STAT(chunk->pairs_visited += j - i - 1;)
+
+        for (; k != -1; k = ctx->island_pairs[k].next1) {
+            differs |= ctx->island_pairs[k].overlapped;
+        }
+
+        ctx->island_row_ends[i] = differs ? -1 - j : j;
+        chunk->diverged |= differs;
+    }
+}
+
+/* Links island pair k into the found order pairs of body id */
+void sr_island_link(sr_Context *ctx, sr_Body_Id id, int k) {
+    sr_Island_Pair *tail;
+
+    if (ctx->island_tails[id] == -1) {
+        ctx->island_heads[id] = k;
+    } else {
+        tail = &(ctx->island_pairs[ctx->island_tails[id]]);
+        if (tail->id1 == id) {
+            tail->next1 = k;
+        } else {
+            tail->next2 = k;
+        }
+    }
+    ctx->island_tails[id] = k;
+}
+
+/* Applies the tick flags, contact and, if rewake is set, the wakes of a pair the islands resolved */
+void sr_join_island_pair(sr_Context *ctx, const sr_Island_Pair *pair, int rewake) {
+    if (ctx->options & SR_OPTION_CONTACTS) {
+        sr_push_contact(ctx, &(pair->contact));
+    }
+    ctx->bodies_tick_data[pair->id1].flags |= pair->t1.flags;
+    ctx->bodies_tick_data[pair->id1].custom_flags |= pair->t1.custom_flags;
+    ctx->bodies_tick_data[pair->id1].children |= pair->t1.children;
+    ctx->bodies_tick_data[pair->id2].flags |= pair->t2.flags;
+    ctx->bodies_tick_data[pair->id2].custom_flags |= pair->t2.custom_flags;
+    ctx->bodies_tick_data[pair->id2].children |= pair->t2.children;
+    if (rewake && pair->woke & 1) {
+        ctx->sleep_idle[pair->id1] = 1;
+    }
+    if (rewake && pair->woke & 2) {
+        ctx->sleep_idle[pair->id2] = 1;
+    }
+}
+
+/* Returns 1 if no body sr_resolve_island_row() moved can change what sorted position i does */
+int sr_is_island_row_clean(sr_Context *ctx, int i, int end) {
+    const sr_Island_Pair *pair;
+    sr_Rect ri, island, sweep;
+    unsigned int skip;
+    int j, k;
+
+    if (ctx->island_dirty[i / 32] >> (i % 32) & 1u) {
+        return 0;
+    }
+
+    skip = SR_DISABLED | SR_NO_COLLISION | (ctx->hot_flags[i] & SR_ASLEEP);
+    for (j = i + 1; j <= end && j < ctx->num_sweep; ++j) {
+        if (j % 32 == 0 && ctx->island_dirty[j / 32] == 0) {
+            j += 31;
+            continue;
+        } else if (!(ctx->island_dirty[j / 32] >> (j % 32) & 1u) || ctx->hot_flags[j] & skip || !sr_do_hot_layers_match(ctx, i, j)) {
+            continue;
+        }
+
+        /* i as the islands had it when they got to j */
+        ri = sr_island_rect_now(ctx, i, i);
+        for (k = ctx->island_cursors[i]; k != -1 && ctx->island_pairs[k].pos2 < j; k = pair->next1) {
+            pair = &(ctx->island_pairs[k]);
+            ri = pair->r1;
+        }
+
+        island = sr_island_rect_now(ctx, j, i);
+        sweep = ctx->island_rects[j];
+        if (sr_do_rects_overlap(ri, island) || sr_do_rects_overlap(ri, sweep) ||
+            (ctx->sweep_direction == SR_SWEEP_X ? (island.min.x > ri.max.x) != (sweep.min.x > ri.max.x) : (island.min.y > ri.max.y) != (sweep.min.y > ri.max.y))) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Keeps the rect the sweep left the body at sorted position j with after position i, which only has to be
+ * remembered while it differs from the one the islands left it with */
+void sr_set_island_rect(sr_Context *ctx, int j, int i, sr_Rect r) {
+    sr_Rect island;
+
+    if (ctx->bodies[ctx->bodies_sorted[j]].priority == SR_PRIORITY_STATIC) {
+        return;
+    }
+
+    island = sr_island_rect_now(ctx, j, i + 1);
+    ctx->island_rects[j] = r;
+    if (r.min.x == island.min.x && r.min.y == island.min.y && r.max.x == island.max.x && r.max.y == island.max.y) {
+        ctx->island_dirty[j / 32] &= ~((SR_U32)1 << (j % 32));
+    } else {
+        ctx->island_dirty[j / 32] |= (SR_U32)1 << (j % 32);
+    }
+}
+
+/* Resolves the pairs of sorted position i like sr_sweep_loop() in place of the islands */
+void sr_resolve_island_row(sr_Context *ctx, int i) {
+    const sr_Island_Pair *pair;
+    sr_Rect ri, rj, saved_i, saved_j;
+    sr_Body_Id id, other;
+    unsigned int skip;
+    int j, k, first;
+#ifdef SR_STATS
+    long overlapping, both_static;
+
+    overlapping = 0;
+    both_static = 0;
+#endif
+
+    id = ctx->bodies_sorted[i];
+    ri = sr_sweep_rect_at(ctx, i, i);
+    first = sr_island_cursor_at(ctx, i, i);
+
+    /* the bodies the islands paired with i take the sweep's rects, even if the sweep doesn't get to them */
+    for (k = first; k != -1; k = pair->next1) {
+        pair = &(ctx->island_pairs[k]);
+        SR_STAT(if (pair->overlapped) sr_count_pair(ctx, pair->id1, pair->id2, &overlapping, &both_static);)
+        ctx->island_rects[pair->pos2] = sr_sweep_rect_at(ctx, pair->pos2, i);
+        ctx->island_dirty[pair->pos2 / 32] |= (SR_U32)1 << (pair->pos2 % 32);
+    }
+    SR_STAT(ctx->stats.pairs_overlapping -= overlapping;)
+    SR_STAT(ctx->stats.pairs_static -= both_static;)
+
+    skip = SR_DISABLED | SR_NO_COLLISION | (ctx->hot_flags[i] & SR_ASLEEP);
+    for (j = i + 1; j < ctx->num_sweep; ++j) {
+        rj = sr_sweep_rect_at(ctx, j, i);
+        if (ctx->sweep_direction == SR_SWEEP_X ? rj.min.x > ri.max.x : rj.min.y > ri.max.y) {
+            break;
+        } else if (ctx->hot_flags[j] & skip || !sr_do_hot_layers_match(ctx, i, j) || !sr_do_rects_overlap(ri, rj)) {
+            continue;
+        }
+
+        /* the bodies hold what the islands left them with, which is put back once the sweep's rects are out */
+        other = ctx->bodies_sorted[j];
+        saved_i = ctx->bodies[id].r;
+        saved_j = ctx->bodies[other].r;
+        ctx->bodies[id].r = ri;
+        ctx->bodies[other].r = rj;
+        sr_resolve_bodies(ctx, id, other);
+        ri = ctx->bodies[id].r;
+        ctx->island_rects[j] = ctx->bodies[other].r;
+        ctx->island_dirty[j / 32] |= (SR_U32)1 << (j % 32);
+        ctx->bodies[id].r = saved_i;
+        ctx->bodies[other].r = saved_j;
+    }
+    SR_STAT(ctx->stats.pairs_visited += j - i - 1;)
+
+    /* every body the sweep or the islands moved here is remembered until the islands catch up with it */
+    sr_set_island_rect(ctx, i, i, ri);
+    for (k = first; k != -1; k = ctx->island_pairs[k].next1) {
+        sr_set_island_rect(ctx, ctx->island_pairs[k].pos2, i, ctx->island_rects[ctx->island_pairs[k].pos2]);
+    }
+    for (k = i + 1; k < j; ++k) {
+        if (ctx->island_dirty[k / 32] >> (k % 32) & 1u) {
+            sr_set_island_rect(ctx, k, i, ctx->island_rects[k]);
+        }
+    }
+}
+
+/* Joins what the islands did in the order of sr_sweep_loop(), with repair set resolving the positions they got wrong again */
+void sr_join_sweep_islands(sr_Context *ctx, int repair) {
+    const sr_Island_Pair *pair;
+    int i, k, end;
+
+    for (i = 0; i < ctx->num_sweep; ++i) {
+        sr_island_cursor_reset(ctx, i);
+    }
+    if (repair) {
+        memset(ctx->island_dirty, 0, (ctx->num_sweep + 31) / 32 * sizeof(SR_U32));
+        /* the wakes are done again, walking backwards leaves every body as it was before its first pair */
+        for (k = ctx->num_island_pairs - 1; k >= 0 && ctx->options & SR_OPTION_SLEEP; --k) {
+            ctx->sleep_idle[ctx->island_pairs[k].id1] = ctx->island_pairs[k].idle1;
+            ctx->sleep_idle[ctx->island_pairs[k].id2] = ctx->island_pairs[k].idle2;
+        }
+    }
+
+    for (i = 0; i < ctx->num_sweep; ++i) {
+        end = ctx->island_row_ends[i];
+        if (repair && (end < 0 || !sr_is_island_row_clean(ctx, i, end))) {
+            SR_STAT(ctx->stats.pairs_visited -= (end < 0 ? -1 - end : end) - i - 1;)
+            sr_resolve_island_row(ctx, i);
+            continue;
+        }
+
+        for (k = sr_island_cursor_at(ctx, i, i); k != -1; k = pair->next1) {
+            pair = &(ctx->island_pairs[k]);
+            sr_join_island_pair(ctx, pair, repair);
+        }
+    }
+
+    /* the hot arrays end up holding the resolved rects, like sr_sweep_loop() leaves them */
+    for (i = 0; i < ctx->num_sweep; ++i) {
+        if (repair && ctx->island_dirty[i / 32] >> (i % 32) & 1u) {
+            ctx->bodies[ctx->bodies_sorted[i]].r = ctx->island_rects[i];
+            sr_store_hot(ctx, i);
+        } else if (ctx->island_paired[i / 32] >> (i % 32) & 1u) {
+            sr_store_hot(ctx, i);
+        }
+    }
+}
+
+/* Resolves the pairs of the chunks island by island on the worker tasks, with the same results as sr_sweep_loop().
+ * Returns -1 without resolving anything if a buffer can't grow. */
+
+int sr_resolve_islands(sr_Context *ctx) {
+    sr_Island_Pair *ip;
+    const sr_Pair *pair;
+    sr_Rect *block;
+    int i, k, n, island, count, new_cap, diverged;
+
+    n = 0;
+    for (i = 0; i < ctx->num_chunks; ++i) {
+        n += ctx->chunks[i].num_pairs;
+    }
+
+    if (n == 0) {
+        return 0;
+    }
+
+    if (n > ctx->island_pairs_cap) {
+        new_cap = ctx->island_pairs_cap > 0 ? ctx->island_pairs_cap : 64;
+        while (new_cap < n) {
+            new_cap *= 2;
+        }
+        ip = SR_REALLOC(SR_ALLOC_CONTEXT, ctx->island_pairs, new_cap * sizeof(sr_Island_Pair));
+        if (ip == NULL) {
+            return -1;
+        }
+        ctx->island_pairs = ip;
+        ctx->island_pairs_cap = new_cap;
+    }
+
+    if (ctx->num_bodies > ctx->island_bodies_cap) {
+        new_cap = ctx->bodies_cap;
+        block = SR_REALLOC(SR_ALLOC_CONTEXT, ctx->island_rects, new_cap * (2 * sizeof(sr_Rect) + 9 * sizeof(int)) + 2 * ((new_cap + 31) / 32) * sizeof(SR_U32));
+        if (block == NULL) {
+            return -1;
+        }
+        ctx->island_rects = block;
+        ctx->island_cursor_rects = block + new_cap;
+        ctx->island_parent = (int *)(ctx->island_cursor_rects + new_cap);
+        ctx->island_ids = ctx->island_parent + new_cap;
+        ctx->island_ends = ctx->island_ids + new_cap;
+        ctx->island_heads = ctx->island_ends + new_cap;
+        ctx->island_tails = ctx->island_heads + new_cap;
+        ctx->island_row_ends = ctx->island_tails + new_cap;
+        ctx->island_first_rows = ctx->island_row_ends + new_cap;
+        ctx->island_cursors = ctx->island_first_rows + new_cap;
+        ctx->island_cursor_rows = ctx->island_cursors + new_cap;
+        ctx->island_paired = (SR_U32 *)(ctx->island_cursor_rows + new_cap);
+        ctx->island_dirty = ctx->island_paired + (new_cap + 31) / 32;
+        ctx->island_bodies_cap = new_cap;
+    }
+
+    for (i = 0; i < ctx->num_bodies; ++i) {
+        ctx->island_parent[i] = i;
+        ctx->island_ids[i] = -1;
+        ctx->island_heads[i] = -1;
+        ctx->island_tails[i] = -1;
+    }
+    memset(ctx->island_paired, 0, (ctx->num_bodies + 31) / 32 * sizeof(SR_U32));
+
+    for (i = 0; i < ctx->num_chunks; ++i) {
+        for (k = 0; k < ctx->chunks[i].num_pairs; ++k) {
+            pair = &(ctx->chunks[i].pairs[k]);
+            if (ctx->bodies[pair->id1].priority != SR_PRIORITY_STATIC && ctx->bodies[pair->id2].priority != SR_PRIORITY_STATIC) {
+                sr_island_union(ctx, pair->id1, pair->id2);
+            }
+        }
+    }
+
+    /* number the islands in order of their first pair and count their pairs */
+    ctx->num_islands = 0;
+    for (i = 0; i < ctx->num_chunks; ++i) {
+        for (k = 0; k < ctx->chunks[i].num_pairs; ++k) {
+            island = sr_island_find(ctx, sr_island_body(ctx, &(ctx->chunks[i].pairs[k])));
+            if (ctx->island_ids[island] < 0) {
+                ctx->island_ids[island] = ctx->num_islands;
+                ctx->island_ends[ctx->num_islands] = 0;
+                ++ctx->num_islands;
+            }
+            ++ctx->island_ends[ctx->island_ids[island]];
+        }
+    }
+
+    /* island_ends holds the starts while scattering and the ends afterwards */
+    count = 0;
+    for (i = 0; i < ctx->num_islands; ++i) {
+        k = ctx->island_ends[i];
+        ctx->island_ends[i] = count;
+        count += k;
+    }
+
+    for (i = 0; i < ctx->num_chunks; ++i) {
+        for (k = 0; k < ctx->chunks[i].num_pairs; ++k) {
+            pair = &(ctx->chunks[i].pairs[k]);
+            island = ctx->island_ids[sr_island_find(ctx, sr_island_body(ctx, pair))];
+            ip = &(ctx->island_pairs[ctx->island_ends[island]]);
+            memset(ip, 0, sizeof(sr_Island_Pair));
+            ip->id1 = pair->id1;
+            ip->id2 = pair->id2;
+            ip->pos1 = pair->pos1;
+            ip->pos2 = pair->pos2;
+            ip->next1 = -1;
+            ip->next2 = -1;
+            ip->contact.id1 = -1;
+            sr_island_link(ctx, pair->id1, ctx->island_ends[island]);
+            sr_island_link(ctx, pair->id2, ctx->island_ends[island]);
+            if (pair->pos1 >= 0 && !(ctx->island_paired[pair->pos1 / 32] >> (pair->pos1 % 32) & 1u)) {
+                ctx->island_paired[pair->pos1 / 32] |= (SR_U32)1 << (pair->pos1 % 32);
+                ctx->island_first_rows[pair->pos1] = pair->pos1;
+            }
+            if (pair->pos2 >= 0 && !(ctx->island_paired[pair->pos2 / 32] >> (pair->pos2 % 32) & 1u)) {
+                ctx->island_paired[pair->pos2 / 32] |= (SR_U32)1 << (pair->pos2 % 32);
+                ctx->island_first_rows[pair->pos2] = pair->pos1;
+            }
+            ++ctx->island_ends[island];
+        }
+    }
+
+    ctx->num_island_pairs = n;
+    ctx->parallel_for(ctx->parallel_user, sr_resolve_islands_task, ctx, ctx->num_chunks);
+
+    if (ctx->parallel_stage == SR_STAGE_SWEEP) {
+        ctx->parallel_for(ctx->parallel_user, sr_check_islands_task, ctx, ctx->num_chunks);
+        diverged = 0;
+        for (i = 0; i < ctx->num_chunks; ++i) {
+            diverged |= ctx->chunks[i].diverged;
+        }
+        sr_join_sweep_islands(ctx, diverged);
+
+        return 0;
+    }
+
+    /* walk the pairs in found order again, with island_tails as the next pair of each island, so the contacts
+     * come out in the order sr_resolve_static_index() pushes them */
+    for (i = 0; i < ctx->num_islands; ++i) {
+        ctx->island_tails[i] = sr_island_start(ctx, i);
+    }
+    for (i = 0; i < ctx->num_chunks; ++i) {
+        for (k = 0; k < ctx->chunks[i].num_pairs; ++k) {
+            island = ctx->island_ids[sr_island_find(ctx, sr_island_body(ctx, &(ctx->chunks[i].pairs[k])))];
+            sr_join_island_pair(ctx, &(ctx->island_pairs[ctx->island_tails[island]++]), 0);
+        }
+    }
+
+    return 0;
+}
+
+/* Records the sorted position of every body and how far back a moved body has to look, long static bodies apart */
+void sr_index_sweep(sr_Context *ctx) {
+    int i;
+
+    ctx->sweep_extent = 0;
+    for (i = 0; i < ctx->num_sweep; ++i) {
+        ctx->sweep_pos[ctx->bodies_sorted[i]] = i;
+        if (ctx->bodies[ctx->bodies_sorted[i]].priority != SR_PRIORITY_STATIC && ctx->hot_sweep_max[i] - ctx->hot_sweep_min[i] > ctx->sweep_extent) {
+            ctx->sweep_extent = ctx->hot_sweep_max[i] - ctx->hot_sweep_min[i];
+        }
+    }
+
+    ctx->num_sweep_long = 0;
+    for (i = 0; i < ctx->num_sweep; ++i) {
+        if (ctx->hot_sweep_max[i] - ctx->hot_sweep_min[i] > ctx->sweep_extent) {
+            ctx->sweep_long[ctx->num_sweep_long++] = ctx->bodies_sorted[i];
+        }
+    }
+    ctx->sweep_indexed = 1;
+}
+
+void sr_sweep_resolve(sr_Context *ctx) {
+    if (ctx->sweep_auto) {
+        sr_update_sweep_axis(ctx);
+    }
+
+    sr_stable_sort(ctx, ctx->bodies_sorted, ctx->num_sweep);
+    sr_gather_hot(ctx);
+    if (ctx->iterations > 1) {
+        sr_index_sweep(ctx);
+    }
+    SR_STAT(sr_end_phase(ctx, &(ctx->stats.time_sort));)
+
+    if (ctx->parallel_for != NULL && sr_parallel_find_pairs(ctx, SR_STAGE_SWEEP, ctx->num_sweep) == 0) {
+        SR_STAT(sr_end_phase(ctx, &(ctx->stats.time_sweep));)
+        if (sr_resolve_islands(ctx) == 0) {
+            SR_STAT(sr_add_chunk_stats(ctx);)
+        } else {
+            sr_sweep_loop(ctx);
+        }
+        SR_STAT(sr_end_phase(ctx, &(ctx->stats.time_resolve));)
+    } else {
+        /* the serial sweep resolves the pairs as it finds them, so that time counts as sweep time */
+        sr_sweep_loop(ctx);
+        SR_STAT(sr_end_phase(ctx, &(ctx->stats.time_sweep));)
+    }
+}
+
+/* Resolves the bodies at the sorted positions i < j if they overlap on the rects the pass started with and still do */
+void sr_resolve_hot_pair(sr_Context *ctx, int i, int j) {
+    SR_STAT(++ctx->stats.pairs_visited;)
+    if ((ctx->hot_flags[i] | ctx->hot_flags[j]) & (SR_DISABLED | SR_NO_COLLISION) ||
+        ctx->hot_flags[i] & ctx->hot_flags[j] & SR_ASLEEP || !sr_do_hot_layers_match(ctx, i, j)) {
+        return;
+    } else if (sr_do_hot_overlap(ctx, i, j) && sr_do_rects_overlap(ctx->bodies[ctx->bodies_sorted[i]].r, ctx->bodies[ctx->bodies_sorted[j]].r)) {
+        sr_resolve_bodies(ctx, ctx->bodies_sorted[i], ctx->bodies_sorted[j]);
+    }
+}
+
+int sr_grid_cell(sr_Scalar pos, sr_Scalar cell_size) {
+#ifdef SR_FIXED
+    SR_U32 mag, ind;
+
+    /* both have the same fraction bits, so the integer quotient is the cell, rounded down */
+    mag = sr_fixed_magnitude(pos);
+    ind = mag / (SR_U32)cell_size;
+    if (pos >= 0) {
+        return (int)ind;
+    }
+
+    return -(int)(ind * (SR_U32)cell_size == mag ? ind : ind + 1u);
+#else
+    sr_Scalar cell;
+    int ind;
+
+    cell = pos / cell_size;
+    if (cell > 1.0e9f) {
+        cell = 1.0e9f;
+    } else if (cell < -1.0e9f) {
+        cell = -1.0e9f;
+    }
+
+    ind = (int)cell;
+    if ((sr_Scalar)ind > cell) {
+        --ind;
+    }
+
+    return ind;
+#endif
+}
+
+int sr_grid_bucket(int cx, int cy, int num_buckets) {
+    return (int)((((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u)) % (unsigned int)num_buckets);
+}
+
+/* Whether a body covering the cells [x0, x1] x [y0, y1] fits into budget entries */
+int sr_grid_fits(int x0, int y0, int x1, int y1, long budget) {
+    long w, h;
+
+    w = (long)x1 - x0 + 1;
+    h = (long)y1 - y0 + 1;
+
+    return w <= budget && h <= budget && w <= budget / h;
+}
+
+/* Counts the entries of a body covering the cells [x0, x1] x [y0, y1] into their buckets and returns how many there are */
+int sr_grid_count(sr_Context *ctx, int x0, int y0, int x1, int y1, int num_buckets) {
+    int cx, cy;
+
+    for (cy = y0; cy <= y1; ++cy) {
+        for (cx = x0; cx <= x1; ++cx) {
+            ++ctx->grid_buckets[sr_grid_bucket(cx, cy, num_buckets)];
+        }
+    }
+
+    return (x1 - x0 + 1) * (y1 - y0 + 1);
+}
+
+/* Sorts the cells of every body into the hash buckets and returns how many bodies went on the large list instead.
+ * grid_cells holds x0, y0, x1, y1 per position, x0 is INT_MIN outside the broadphase and INT_MAX for large bodies. */
+int sr_grid_build(sr_Context *ctx, int num_buckets) {
+    int *cells;
+    long budget;
+    int i, k, cx, cy, bucket, sum, count, num_large;
+
+    memset(ctx->grid_buckets, 0, num_buckets * sizeof(int));
+    budget = (long)SR_GRID_MAX_CELLS * ctx->bodies_cap;
+    num_large = 0;
+
+    for (i = 0; i < ctx->num_sweep; ++i) {
+        cells = &(ctx->grid_cells[4 * i]);
+        if (!sr_is_body_in_broadphase(ctx, &(ctx->bodies[ctx->bodies_sorted[i]]))) {
+            cells[0] = INT_MIN;
+            continue;
+        }
+
+        cells[0] = sr_grid_cell(ctx->hot_cross_min[i], ctx->grid_cell_size);
+        cells[1] = sr_grid_cell(ctx->hot_sweep_min[i], ctx->grid_cell_size);
+        cells[2] = sr_grid_cell(ctx->hot_cross_max[i], ctx->grid_cell_size);
+        cells[3] = sr_grid_cell(ctx->hot_sweep_max[i], ctx->grid_cell_size);
+        if (!sr_grid_fits(cells[0], cells[1], cells[2], cells[3], SR_GRID_MAX_CELLS)) {
+            ctx->grid_large[num_large++] = i;
+        } else {
+            budget -= sr_grid_count(ctx, cells[0], cells[1], cells[2], cells[3], num_buckets);
+        }
+    }
+
+    /* grid_large holds the candidates and is compacted to the bodies that don't fit */
+    count = 0;
+    for (k = 0; k < num_large; ++k) {
+        i = ctx->grid_large[k];
+        cells = &(ctx->grid_cells[4 * i]);
+        if (sr_grid_fits(cells[0], cells[1], cells[2], cells[3], budget)) {
+            budget -= sr_grid_count(ctx, cells[0], cells[1], cells[2], cells[3], num_buckets);
+        } else {
+            cells[0] = INT_MAX;
+            ctx->grid_large[count++] = i;
+        }
+    }
+    num_large = count;
+
+    sum = 0;
+    for (i = 0; i < num_buckets; ++i) {
+        count = ctx->grid_buckets[i];
+        ctx->grid_buckets[i] = sum;
+        sum += count;
+    }
+
+    /* afterwards grid_buckets[i] is the end of bucket i and the start of bucket i + 1 */
+    for (i = 0; i < ctx->num_sweep; ++i) {
+        cells = &(ctx->grid_cells[4 * i]);
+        if (cells[0] == INT_MAX || cells[0] == INT_MIN) {
+            continue;
+        }
+
+        for (cy = cells[1]; cy <= cells[3]; ++cy) {
+            for (cx = cells[0]; cx <= cells[2]; ++cx) {
+                bucket = sr_grid_bucket(cx, cy, num_buckets);
+                ctx->grid_entries[ctx->grid_buckets[bucket]].pos = i;
+                ctx->grid_entries[ctx->grid_buckets[bucket]].cx = cx;
+                ctx->grid_entries[ctx->grid_buckets[bucket]].cy = cy;
+                ++ctx->grid_buckets[bucket];
+            }
+        }
+    }
+
+    return num_large;
+}
+
+/* Writes the positions after i sharing a cell with the small body at i to found, each pair only in the first cell they share */
+int sr_grid_find_later(sr_Context *ctx, int i, int num_buckets, int *found) {
+    const sr_Grid_Entry *e;
+    const int *cells, *other;
+    int n, cx, cy, bucket, begin, k;
+
+    n = 0;
+    cells = &(ctx->grid_cells[4 * i]);
+    for (cy = cells[1]; cy <= cells[3]; ++cy) {
+        for (cx = cells[0]; cx <= cells[2]; ++cx) {
+            bucket = sr_grid_bucket(cx, cy, num_buckets);
+            /* the entries of a bucket are in sorted order, so the later ones are at its end */
+            begin = bucket > 0 ? ctx->grid_buckets[bucket - 1] : 0;
+            for (k = ctx->grid_buckets[bucket] - 1; k >= begin && ctx->grid_entries[k].pos > i; --k) {
+                e = &(ctx->grid_entries[k]);
+                other = &(ctx->grid_cells[4 * e->pos]);
+                if (e->cx == cx && e->cy == cy && cx == (cells[0] > other[0] ? cells[0] : other[0]) && cy == (cells[1] > other[1] ? cells[1] : other[1])) {
+                    found[n++] = e->pos;
+                }
+            }
+        }
+    }
+
+    return n;
+}
+
+/* Resolves the bodies at the sorted positions i < j like sr_sweep_loop() does */
+void sr_grid_resolve_pair(sr_Context *ctx, int i, int j) {
+    SR_STAT(++ctx->stats.pairs_visited;)
+    if (ctx->hot_flags[j] & (SR_DISABLED | SR_NO_COLLISION | (ctx->hot_flags[i] & SR_ASLEEP)) || !sr_do_hot_layers_match(ctx, i, j)) {
+        return;
+    } else if (sr_do_hot_overlap(ctx, i, j)) {
+        sr_resolve_bodies(ctx, ctx->bodies_sorted[i], ctx->bodies_sorted[j]);
+        sr_store_hot(ctx, i);
+        sr_store_hot(ctx, j);
+    }
+}
+
+/* Resolves each body with the later ones it shares a cell with and the large ones it reaches, in sweep order */
+
+void sr_grid_resolve(sr_Context *ctx) {
+    int *found;
+    int num_buckets, num_large, next_large, n, i, j, k, pos;
+
+    sr_stable_sort(ctx, ctx->bodies_sorted, ctx->num_sweep);
+    sr_gather_hot(ctx);
+    if (ctx->iterations > 1) {
+        sr_index_sweep(ctx);
+    }
+    num_buckets = 2 * ctx->bodies_cap;
+    num_large = sr_grid_build(ctx, num_buckets);
+    SR_STAT(sr_end_phase(ctx, &(ctx->stats.time_sort));)
+
+    found = ctx->sort_ids;
+    next_large = 0;
+    for (i = 0; i < ctx->num_sweep; ++i) {
+        while (next_large < num_large && ctx->grid_large[next_large] <= i) {
+            ++next_large;
+        }
+
+        if (ctx->grid_cells[4 * i] == INT_MIN) {
+            continue;
+        } else if (ctx->grid_cells[4 * i] == INT_MAX) {
+            for (j = i + 1; j < ctx->num_sweep && ctx->hot_sweep_min[j] <= ctx->hot_sweep_max[i]; ++j) {
+                sr_grid_resolve_pair(ctx, i, j);
+            }
+            continue;
+        }
+
+        n = sr_grid_find_later(ctx, i, num_buckets, found);
+        for (k = next_large; k < num_large && ctx->hot_sweep_min[ctx->grid_large[k]] <= ctx->hot_sweep_max[i]; ++k) {
+            found[n++] = ctx->grid_large[k];
+        }
+
+        for (k = 1; k < n; ++k) {
+            pos = found[k];
+            for (j = k; j > 0 && found[j - 1] > pos; --j) {
+                found[j] = found[j - 1];
+            }
+            found[j] = pos;
+        }
+        for (k = 0; k < n; ++k) {
+            sr_grid_resolve_pair(ctx, i, found[k]);
+        }
+    }
+    SR_STAT(sr_end_phase(ctx, &(ctx->stats.time_sweep));)
+}
+
+/* Resolves every pair of overlapping leaves of the two subtrees, or of one subtree if root1 == root2 */
+
+void sr_tree_resolve_pairs(sr_Context *ctx, int root1, int root2) {
+    const sr_Tree_Node *n1, *n2;
+    int stack[2 * SR_TREE_STACK_SIZE];
+    int top, a, b;
+
+    if (root1 == -1 || root2 == -1) {
+        return;
+    }
+
+    top = 0;
+    stack[top++] = root1;
+    stack[top++] = root2;
+
+    while (top > 0) {
+        b = stack[--top];
+        a = stack[--top];
+        n1 = &(ctx->tree_nodes[a]);
+        n2 = &(ctx->tree_nodes[b]);
+
+        SR_ASSERT(top + 6 <= 2 * SR_TREE_STACK_SIZE && "tree too deep for SR_TREE_STACK_SIZE");
+
+        if (a == b) {
+            if (n1->child1 != -1) {
+                stack[top++] = n1->child1;
+                stack[top++] = n1->child2;
+                stack[top++] = n1->child2;
+                stack[top++] = n1->child2;
+                stack[top++] = n1->child1;
+                stack[top++] = n1->child1;
+            }
+        } else if (!sr_do_rects_overlap(n1->aabb, n2->aabb)) {
+            continue;
+        } else if (n1->child1 == -1 && n2->child1 == -1) {
+            SR_STAT(++ctx->stats.pairs_visited;)
+            if (ctx->bodies[n2->body].flags & (SR_DISABLED | SR_NO_COLLISION)) {
+                /* only possible for a static index leaf */
+                continue;
+            } else if (sr_do_layers_match(ctx, n1->body, n2->body) && !sr_is_pair_asleep(ctx, n1->body, n2->body) && sr_do_rects_overlap(ctx->bodies[n1->body].r, ctx->bodies[n2->body].r)) {
+                if (n1->body < n2->body) {
+                    sr_resolve_bodies(ctx, n1->body, n2->body);
+                } else {
+                    sr_resolve_bodies(ctx, n2->body, n1->body);
+                }
+            }
+        } else if (n2->child1 == -1 || (n1->child1 != -1 && sr_rect_perimeter(n1->aabb) >= sr_rect_perimeter(n2->aabb))) {
+            stack[top++] = n1->child2;
+            stack[top++] = b;
+            stack[top++] = n1->child1;
+            stack[top++] = b;
+        } else {
+            stack[top++] = a;
+            stack[top++] = n2->child2;
+            stack[top++] = a;
+            stack[top++] = n2->child1;
+        }
+    }
+}
+
+void sr_tree_resolve(sr_Context *ctx) {
+    sr_tree_update_moved(ctx);
+    SR_STAT(sr_end_phase(ctx, &(ctx->stats.time_sort));)
+
+    /* dynamic pairs first, then dynamic bodies against the static tree */
+    sr_tree_resolve_pairs(ctx, ctx->tree_roots[SR_TREE_DYNAMIC], ctx->tree_roots[SR_TREE_DYNAMIC]);
+    sr_tree_resolve_pairs(ctx, ctx->tree_roots[SR_TREE_DYNAMIC], ctx->tree_roots[SR_TREE_STATIC]);
+    SR_STAT(sr_end_phase(ctx, &(ctx->stats.time_sweep));)
+}
+
+void sr_resolve_static_index(sr_Context *ctx, sr_Body_Id id) {
+    sr_Body_Id other;
+    int k, count;
+
+    count = sr_tree_query_rect(ctx, SR_TREE_STATIC, ctx->bodies[id].r, ctx->sort_ids, ctx->num_bodies);
+
+    for (k = 0; k < count; ++k) {
+        other = ctx->sort_ids[k];
+        if (ctx->bodies[other].flags & (SR_DISABLED | SR_NO_COLLISION) || !sr_do_layers_match(ctx, id, other) || sr_is_pair_asleep(ctx, id, other)) {
+            continue;
+        }
+        SR_STAT(++ctx->stats.pairs_visited;)
+        if (sr_do_rects_overlap(ctx->bodies[id].r, ctx->bodies[other].r)) {
+            if (id < other) {
+                sr_resolve_bodies(ctx, id, other);
+            } else {
+                sr_resolve_bodies(ctx, other, id);
+            }
+        }
+    }
+}
+
+/* Points the tilemap arrays of ctx into mem and returns the bytes they take, mem may be NULL to only get the size */
+size_t sr_context_carve_tiles(sr_Context *ctx, void *mem, int num_tiles) {
+    size_t at;
+
+    at = 0;
+    ctx->tile_rects = sr_carve_array(mem, &at, num_tiles * sizeof(int));
+    ctx->tile_spans = sr_carve_array(mem, &at, 2 * num_tiles * sizeof(int));
+    ctx->tiles = sr_carve_array(mem, &at, num_tiles * sizeof(unsigned char));
+
+    return at;
+}
+
+/* Replaces the tilemap with a copy of tiles, NULL for an empty map. Returns -1 if it can't be allocated. */
+int sr_context_set_tilemap(sr_Context *ctx, const unsigned char *tiles, int width, int height, sr_Vec2 origin, sr_Scalar tile_size) {
+    sr_Context layout;
+    void *mem;
+
+    if (width <= 0 || height <= 0) {
+        SR_FREE(SR_ALLOC_CONTEXT, ctx->tile_rects);
+        ctx->tiles = NULL;
+        ctx->tile_rects = NULL;
+        ctx->tile_spans = NULL;
+        ctx->tiles_width = 0;
+        ctx->tiles_height = 0;
+        ctx->tiles_dirty = 0;
+        return 0;
+    } else if (!(tile_size > 0) || width > INT_MAX / 2 / height || ctx->fixed_memory) {
+        return -1;
+    }
+
+    mem = SR_REALLOC(SR_ALLOC_CONTEXT, NULL, sr_context_carve_tiles(&layout, NULL, width * height));
+    if (mem == NULL) {
+        return -1;
+    }
+
+    SR_FREE(SR_ALLOC_CONTEXT, ctx->tile_rects);
+    sr_context_carve_tiles(ctx, mem, width * height);
+    if (tiles != NULL) {
+        memcpy(ctx->tiles, tiles, width * height);
+    } else {
+        memset(ctx->tiles, 0, width * height);
+    }
+    ctx->tiles_width = width;
+    ctx->tiles_height = height;
+    ctx->tiles_origin = origin;
+    ctx->tile_size = tile_size;
+    ctx->tiles_dirty = 1;
+
+    return 0;
+}
+
+/* Changes one tile, the rects are merged again on the next tick. With SR_OPTION_SLEEP the bodies touching it wake up. */
+int sr_set_tile(sr_Context *ctx, int x, int y, unsigned char tile) {
+    sr_Rect r;
+    int k, count;
+
+    if (x < 0 || y < 0 || x >= ctx->tiles_width || y >= ctx->tiles_height) {
+        return -1;
+    } else if (ctx->tiles[y * ctx->tiles_width + x] == tile) {
+        return 0;
+    }
+
+    ctx->tiles[y * ctx->tiles_width + x] = tile;
+    ctx->tiles_dirty = 1;
+
+    if (ctx->options & SR_OPTION_SLEEP) {
+        r.min.x = ctx->tiles_origin.x + (sr_Scalar)x * ctx->tile_size;
+        r.min.y = ctx->tiles_origin.y + (sr_Scalar)y * ctx->tile_size;
+        r.max.x = ctx->tiles_origin.x + (sr_Scalar)(x + 1) * ctx->tile_size;
+        r.max.y = ctx->tiles_origin.y + (sr_Scalar)(y + 1) * ctx->tile_size;
+        sr_update_query_index(ctx);
+        count = sr_query_append(ctx->sort_ids, ctx->num_bodies, 0, ctx, r, 0);
+        for (k = 0; k < count; ++k) {
+            if (ctx->sleep_idle[ctx->sort_ids[k]] > 1) {
+                ctx->sleep_idle[ctx->sort_ids[k]] = 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Returns the tile at x, y, or -1 if it is outside the map */
+int sr_get_tile(const sr_Context *ctx, int x, int y) {
+    if (x < 0 || y < 0 || x >= ctx->tiles_width || y >= ctx->tiles_height) {
+        return -1;
+    } else {
+        return ctx->tiles[y * ctx->tiles_width + x];
+    }
+}
+
+/* Merges runs of equal solid tiles into rects, first along the rows and then down */
+void sr_merge_tiles(sr_Context *ctx) {
+    int x, y, w, h, k, first, width;
+    unsigned char tile;
+
+    width = ctx->tiles_width;
+    for (k = 0; k < width * ctx->tiles_height; ++k) {
+        ctx->tile_rects[k] = -1;
+    }
+
+    for (y = 0; y < ctx->tiles_height; ++y) {
+        for (x = 0; x < width; ++x) {
+            first = y * width + x;
+            tile = ctx->tiles[first];
+            if (tile == 0 || ctx->tile_rects[first] != -1) {
+                continue;
+            }
+
+            for (w = 1; x + w < width && ctx->tiles[first + w] == tile && ctx->tile_rects[first + w] == -1; ++w) {
+            }
+            for (h = 1; y + h < ctx->tiles_height; ++h) {
+                for (k = 0; k < w && ctx->tiles[first + h * width + k] == tile && ctx->tile_rects[first + h * width + k] == -1; ++k) {
+                }
+                if (k < w) {
+                    break;
+                }
+            }
+
+            for (k = 0; k < w * h; ++k) {
+                ctx->tile_rects[first + k / w * width + k % w] = first;
+            }
+            ctx->tile_spans[2 * first] = w;
+            ctx->tile_spans[2 * first + 1] = h;
+        }
+    }
+
+    ctx->tiles_dirty = 0;
+}
+
+/* The tile position at pos, by the same formula the tile rects are made with */
+sr_Scalar sr_tile_pos(sr_Scalar origin, int tile, sr_Scalar tile_size) {
+    return origin + (sr_Scalar)tile * tile_size;
+}
+
+/* Finds the tiles along one axis of the map whose extent touches [lo, hi], last < first if there are none */
+void sr_tile_range(int *first_out, int *last_out, sr_Scalar lo, sr_Scalar hi, sr_Scalar origin, sr_Scalar tile_size, int num_tiles) {
+    int first, last;
+
+    first = sr_grid_cell(lo - origin, tile_size);
+    first = first < 0 ? 0 : first > num_tiles ? num_tiles : first;
+    while (first > 0 && sr_tile_pos(origin, first, tile_size) >= lo) {
+        --first;
+    }
+    while (first < num_tiles && sr_tile_pos(origin, first + 1, tile_size) < lo) {
+        ++first;
+    }
+
+    last = sr_grid_cell(hi - origin, tile_size);
+    last = last < -1 ? -1 : last >= num_tiles ? num_tiles - 1 : last;
+    while (last < num_tiles - 1 && sr_tile_pos(origin, last + 1, tile_size) <= hi) {
+        ++last;
+    }
+    while (last >= 0 && sr_tile_pos(origin, last, tile_size) > hi) {
+        --last;
+    }
+
+    *first_out = first;
+    *last_out = last;
+}
+
+/* The rect of the merged tiles whose first tile is first */
+void sr_merged_tile_rect(sr_Rect *r_out, const sr_Context *ctx, int first) {
+    int fx, fy;
+
+    fx = first % ctx->tiles_width;
+    fy = first / ctx->tiles_width;
+    r_out->min.x = sr_tile_pos(ctx->tiles_origin.x, fx, ctx->tile_size);
+    r_out->min.y = sr_tile_pos(ctx->tiles_origin.y, fy, ctx->tile_size);
+    r_out->max.x = sr_tile_pos(ctx->tiles_origin.x, fx + ctx->tile_spans[2 * first], ctx->tile_size);
+    r_out->max.y = sr_tile_pos(ctx->tiles_origin.y, fy + ctx->tile_spans[2 * first + 1], ctx->tile_size);
+}
+
+/* Resolves body id against the tile rects it touches like against static bodies, counting them unless NULL */
+void sr_resolve_tiles(sr_Context *ctx, sr_Body_Id id, long *visited, long *overlapping) {
+    sr_Body tile_body, *b;
+    sr_Body_Tick_Data tile_data;
+    sr_Vec2 old_min;
+    int x0, x1, y0, y1, x, y, first, fx, fy, num_visited, count;
+
+    b = &(ctx->bodies[id]);
+    if (b->priority == SR_PRIORITY_STATIC || b->flags & (SR_DISABLED | SR_NO_COLLISION) || ctx->bodies_tick_data[id].flags & SR_ASLEEP) {
+        return;
+    }
+
+    sr_tile_range(&x0, &x1, b->r.min.x, b->r.max.x, ctx->tiles_origin.x, ctx->tile_size, ctx->tiles_width);
+    sr_tile_range(&y0, &y1, b->r.min.y, b->r.max.y, ctx->tiles_origin.y, ctx->tile_size, ctx->tiles_height);
+
+    tile_body.offset.x = 0;
+    tile_body.offset.y = 0;
+    tile_body.priority = SR_PRIORITY_STATIC;
+    tile_body.flags = 0;
+    tile_body.category = ~0u;
+    tile_body.mask = ~0u;
+    old_min = b->r.min;
+    num_visited = 0;
+    count = 0;
+
+    for (y = y0; y <= y1; ++y) {
+        for (x = x0; x <= x1; ++x) {
+            first = ctx->tile_rects[y * ctx->tiles_width + x];
+            if (first == -1) {
+                continue;
+            }
+            fx = first % ctx->tiles_width;
+            fy = first / ctx->tiles_width;
+            if (x != (fx > x0 ? fx : x0) || y != (fy > y0 ? fy : y0)) {
+                continue;
+            }
+
+            sr_merged_tile_rect(&(tile_body.r), ctx, first);
+            ++num_visited;
+            /* earlier rects may have pushed the body away */
+            if (sr_do_rects_overlap(b->r, tile_body.r)) {
+                tile_body.custom_flags = ctx->tiles[first];
+                if (ctx->child_counts[id] == 0) {
+                    sr_separate_bodies(b, &tile_body, &(ctx->bodies_tick_data[id]), &tile_data, NULL);
+                    ++count;
+                } else if (sr_separate_children(b, &tile_body, sr_body_children(ctx, id), ctx->child_counts[id], NULL, 0, &(ctx->bodies_tick_data[id]), &tile_data, NULL) > 0) {
+                    ++count;
+                }
+            }
+        }
+    }
+
+    if (ctx->options & SR_OPTION_SLEEP && ctx->sleep_idle[id] > 1
+        && (sr_abs(b->r.min.x - old_min.x) > SR_SLEEP_TOLERANCE || sr_abs(b->r.min.y - old_min.y) > SR_SLEEP_TOLERANCE)) {
+        ctx->sleep_idle[id] = 1;
+    }
+
+    if (visited != NULL) {
+        *visited += num_visited;
+        *overlapping += count;
+    }
+}
+
+void sr_resolve_tiles_task(void *task_data, int index) {
+    sr_Context *ctx;
+    int i, end;
+
+    ctx = task_data;
+    end = (int)((long)ctx->num_bodies * (index + 1) / ctx->num_chunks);
+
+    for (i = (int)((long)ctx->num_bodies * index / ctx->num_chunks); i < end; ++i) {
+#ifdef SR_STATS
+        sr_resolve_tiles(ctx, i, &(ctx->chunks[index].pairs_visited), &(ctx->chunks[index].pairs_overlapping));
+#else
+        sr_resolve_tiles(ctx, i, NULL, NULL);
+#endif
+    }
+}
+
+/* Resolves every body against the tilemap, the bodies don't affect each other here so they are split between the tasks */
+void sr_resolve_tilemap(sr_Context *ctx) {
+    int i;
+
+    if (ctx->tiles == NULL) {
+        return;
+    } else if (ctx->tiles_dirty) {
+        sr_merge_tiles(ctx);
+    }
+
+    if (ctx->parallel_for != NULL) {
+        for (i = 0; i < ctx->num_chunks; ++i) {
+            SR_STAT(ctx->chunks[i].pairs_visited = 0;)
+            SR_STAT(ctx->chunks[i].pairs_overlapping = 0;)
+            SR_STAT(ctx->chunks[i].pairs_static = 0;)
+        }
+        ctx->parallel_for(ctx->parallel_user, sr_resolve_tiles_task, ctx, ctx->num_chunks);
+        SR_STAT(sr_add_chunk_stats(ctx);)
+    } else {
+        for (i = 0; i < ctx->num_bodies; ++i) {
+#ifdef SR_STATS
+            sr_resolve_tiles(ctx, i, &(ctx->stats.pairs_visited), &(ctx->stats.pairs_overlapping));
+#else
+            sr_resolve_tiles(ctx, i, NULL, NULL);
+#endif
+        }
+    }
+}
+
+/* Sets t_out in [0, 1) where r moving by move first hits other and axis_out to 0 for x or 1 for y. Returns 0 if it
+ * doesn't, or if r already overlaps other by more than SR_CONTINUOUS_SLOP. */
+
+int sr_rect_time_of_impact(sr_Scalar *t_out, int *axis_out, sr_Rect r, sr_Vec2 move, sr_Rect other) {
+    sr_Scalar rmin[2], rmax[2], omin[2], omax[2], m[2], enter[2], exit[2], gap;
+    int a;
+
+    rmin[0] = r.min.x; rmin[1] = r.min.y;
+    rmax[0] = r.max.x; rmax[1] = r.max.y;
+    omin[0] = other.min.x; omin[1] = other.min.y;
+    omax[0] = other.max.x; omax[1] = other.max.y;
+    m[0] = move.x; m[1] = move.y;
+
+    for (a = 0; a < 2; ++a) {
+        if (m[a] == 0) {
+            if (rmax[a] <= omin[a] + SR_CONTINUOUS_SLOP || rmin[a] >= omax[a] - SR_CONTINUOUS_SLOP) {
+                return 0;
+            }
+            enter[a] = -SR_SCALAR(1);
+            exit[a] = SR_SCALAR(2);
+            continue;
+        }
+
+        gap = m[a] > 0 ? omin[a] - rmax[a] : rmin[a] - omax[a];
+        if (gap < -SR_CONTINUOUS_SLOP) {
+            enter[a] = -SR_SCALAR(1);
+        } else {
+            enter[a] = gap > 0 ? sr_div(gap, sr_abs(m[a])) : 0;
+        }
+        exit[a] = sr_div(m[a] > 0 ? omax[a] - rmin[a] : rmax[a] - omin[a], sr_abs(m[a]));
+    }
+
+    a = enter[1] > enter[0];
+    if (enter[a] < 0 || enter[a] >= SR_SCALAR(1) || enter[a] >= exit[0] || enter[a] >= exit[1]) {
+        return 0;
+    }
+
+    *t_out = enter[a];
+    *axis_out = a;
+
+    return 1;
+}
+
+/* Moves a SR_CONTINUOUS body back to the first static body or tile rect on its path and slides it along that */
+
+void sr_resolve_continuous(sr_Context *ctx, sr_Body_Id id) {
+    sr_Body *b;
+    sr_Rect start, swept, tile_r, best_r;
+    sr_Vec2 move;
+    sr_Scalar w, h, t, best_t;
+    int k, count, iter, axis, best_axis, found, x0, x1, y0, y1, x, y, first, fx, fy;
+    sr_Body_Id other;
+
+    b = &(ctx->bodies[id]);
+    move.x = b->r.min.x - ctx->prev_min[id].x;
+    move.y = b->r.min.y - ctx->prev_min[id].y;
+    w = b->r.max.x - b->r.min.x;
+    h = b->r.max.y - b->r.min.y;
+
+    start.min = ctx->prev_min[id];
+    start.max.x = start.min.x + w;
+    start.max.y = start.min.y + h;
+    swept.min.x = start.min.x < b->r.min.x ? start.min.x : b->r.min.x;
+    swept.min.y = start.min.y < b->r.min.y ? start.min.y : b->r.min.y;
+    swept.max.x = start.max.x > b->r.max.x ? start.max.x : b->r.max.x;
+    swept.max.y = start.max.y > b->r.max.y ? start.max.y : b->r.max.y;
+
+    /* the rest of the move after a hit stays inside the swept rect, so one query covers every step */
+    if (ctx->options & SR_OPTION_STATIC_INDEX) {
+        count = sr_tree_query_rect(ctx, SR_TREE_STATIC, swept, ctx->sort_ids, ctx->num_bodies);
+    } else {
+        count = sr_query_append(ctx->sort_ids, ctx->num_bodies, 0, ctx, swept, 0);
+    }
+
+    x0 = 0;
+    x1 = -1;
+    y0 = 0;
+    y1 = -1;
+    if (ctx->tiles != NULL) {
+        sr_tile_range(&x0, &x1, swept.min.x, swept.max.x, ctx->tiles_origin.x, ctx->tile_size, ctx->tiles_width);
+        sr_tile_range(&y0, &y1, swept.min.y, swept.max.y, ctx->tiles_origin.y, ctx->tile_size, ctx->tiles_height);
+    }
+
+    for (iter = 0; iter < 2 && (move.x != 0 || move.y != 0); ++iter) {
+        found = 0;
+        best_t = SR_SCALAR(1);
+        best_axis = 0;
+        for (k = 0; k < count; ++k) {
+            other = ctx->sort_ids[k];
+            if (other == id || ctx->bodies[other].priority != SR_PRIORITY_STATIC || ctx->bodies[other].flags & (SR_DISABLED | SR_NO_COLLISION) || !sr_do_layers_match(ctx, id, other)) {
+                continue;
+            } else if (sr_rect_time_of_impact(&t, &axis, start, move, ctx->bodies[other].r) && t < best_t) {
+                found = 1;
+                best_r = ctx->bodies[other].r;
+                best_t = t;
+                best_axis = axis;
+            }
+        }
+
+        /* the tile rects under the swept rect, each visited once like in sr_resolve_tiles() */
+        for (y = y0; y <= y1; ++y) {
+            for (x = x0; x <= x1; ++x) {
+                first = ctx->tile_rects[y * ctx->tiles_width + x];
+                if (first == -1) {
+                    continue;
+                }
+                fx = first % ctx->tiles_width;
+                fy = first / ctx->tiles_width;
+                if (x != (fx > x0 ? fx : x0) || y != (fy > y0 ? fy : y0)) {
+                    continue;
+                }
+
+                sr_merged_tile_rect(&tile_r, ctx, first);
+                if (sr_rect_time_of_impact(&t, &axis, start, move, tile_r) && t < best_t) {
+                    found = 1;
+                    best_r = tile_r;
+                    best_t = t;
+                    best_axis = axis;
+                }
+            }
+        }
+
+        if (!found) {
+            return;
+        }
+
+        if (best_axis == 0) {
+            start.min.x = move.x > 0 ? best_r.min.x - w : best_r.max.x;
+            start.min.y += sr_mul(move.y, best_t);
+            move.x = 0;
+            move.y = sr_mul(move.y, SR_SCALAR(1) - best_t);
+        } else {
+            start.min.x += sr_mul(move.x, best_t);
+            start.min.y = move.y > 0 ? best_r.min.y - h : best_r.max.y;
+            move.x = sr_mul(move.x, SR_SCALAR(1) - best_t);
+            move.y = 0;
+        }
+        start.max.x = start.min.x + w;
+        start.max.y = start.min.y + h;
+
+        b->r.min.x = start.min.x + move.x;
+        b->r.min.y = start.min.y + move.y;
+        b->r.max.x = b->r.min.x + w;
+        b->r.max.y = b->r.min.y + h;
+    }
+}
+
+void sr_resolve_continuous_bodies(sr_Context *ctx) {
+    const sr_Body *b;
+    int i, found;
+
+    /* continuous bodies sweep against the merged tile rects */
+    if (ctx->tiles != NULL && ctx->tiles_dirty) {
+        sr_merge_tiles(ctx);
+    }
+
+    found = 0;
+    for (i = 0; i < ctx->num_bodies; ++i) {
+        b = &(ctx->bodies[i]);
+        if (!(b->flags & SR_CONTINUOUS) || b->flags & (SR_DISABLED | SR_NO_COLLISION) || b->priority == SR_PRIORITY_STATIC
+            || (b->r.min.x == ctx->prev_min[i].x && b->r.min.y == ctx->prev_min[i].y)) {
+            continue;
+        }
+
+        /* static bodies don't move during the pass, so the query index stays good for them */
+        if (!found && !(ctx->options & SR_OPTION_STATIC_INDEX)) {
+            sr_update_query_index(ctx);
+        }
+        found = 1;
+        sr_resolve_continuous(ctx, i);
+    }
+
+    if (found) {
+        ctx->query_dirty = 1;
+    }
+}
+
+/* Clears the tick data of awake and static bodies and flags the sleeping ones with SR_ASLEEP */
+
+void sr_begin_sleep_tick(sr_Context *ctx) {
+    sr_Body_Tick_Data *t;
+    int i, id1, id2;
+
+    for (i = 0; i < ctx->num_bodies; ++i) {
+        t = &(ctx->bodies_tick_data[i]);
+        if (ctx->bodies[i].priority == SR_PRIORITY_STATIC) {
+            t->flags = ctx->sleep_idle[i] > 0 ? SR_ASLEEP : 0;
+            t->custom_flags = 0;
+            t->children = 0;
+        } else if (ctx->sleep_idle[i] >= ctx->sleep_ticks) {
+            t->flags |= SR_ASLEEP;
+        } else {
+            t->flags = 0;
+            t->custom_flags = 0;
+            t->children = 0;
+        }
+    }
+
+    /* contacts between sleeping bodies aren't resolved again, so they carry over */
+    if (ctx->options & SR_OPTION_CONTACTS) {
+        for (i = 0; i < ctx->num_prev_contacts; ++i) {
+            id1 = sr_body_index(ctx, ctx->prev_contacts[i].id1);
+            id2 = sr_body_index(ctx, ctx->prev_contacts[i].id2);
+            if (id1 >= 0 && id2 >= 0 && sr_is_pair_asleep(ctx, id1, id2)) {
+                sr_append_contact(ctx, &(ctx->prev_contacts[i]));
+            }
+        }
+    }
+}
+
+void sr_end_sleep_tick(sr_Context *ctx) {
+    int i;
+
+    for (i = 0; i < ctx->num_bodies; ++i) {
+        if (ctx->sleep_idle[i] < ctx->sleep_ticks) {
+            ++ctx->sleep_idle[i];
+        }
+    }
+}
+
+/* Remembers where every body is at the start of the first pass */
+void sr_begin_passes(sr_Context *ctx) {
+    int i;
+
+    for (i = 0; i < ctx->num_bodies; ++i) {
+        ctx->pass_min[i] = ctx->bodies[i].r.min;
+    }
+    ctx->sweep_indexed = 0;
+}
+
+int sr_did_body_move(const sr_Context *ctx, sr_Body_Id id) {
+    return (ctx->moved[id / 32] >> (id % 32)) & 1u;
+}
+
+/* Sets the moved bit of the bodies that moved in the pass and returns how many did, their hot sweep keys go back to
+ * the pass start so sr_reinsert_moved() finds them sorted */
+
+int sr_end_pass(sr_Context *ctx) {
+    int i, count;
+
+    memset(ctx->moved, 0, (ctx->num_bodies + 31) / 32 * sizeof(SR_U32));
+
+    count = 0;
+    for (i = 0; i < ctx->num_bodies; ++i) {
+        if (ctx->bodies[i].r.min.x != ctx->pass_min[i].x || ctx->bodies[i].r.min.y != ctx->pass_min[i].y) {
+            if (ctx->sweep_indexed) {
+                ctx->hot_sweep_min[ctx->sweep_pos[i]] = ctx->sweep_direction == SR_SWEEP_X ? ctx->pass_min[i].x : ctx->pass_min[i].y;
+            }
+            ctx->moved[i / 32] |= (SR_U32)1 << (i % 32);
+            ctx->pass_min[i] = ctx->bodies[i].r.min;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+/* Returns the first body from id on whose moved bit is set, or -1 */
+int sr_next_moved(const sr_Context *ctx, int id) {
+    SR_U32 bits;
+    int word;
+
+    for (word = id / 32; word < (ctx->num_bodies + 31) / 32; ++word) {
+        bits = ctx->moved[word];
+        if (word == id / 32) {
+            bits &= (SR_U32)(0xFFFFFFFFul << (id % 32));
+        }
+        if (bits != 0) {
+            for (id = word * 32; !((bits >> (id % 32)) & 1u); ++id) {
+            }
+            return id;
+        }
     }
 
-    b.r.min.x = xpos - b.offset.x;
-    b.r.min.y = ypos - b.offset.y;
-    b.r.max.x = b.r.min.x + xdim;
-    b.r.max.y = b.r.min.y + ydim;
+    return -1;
+}
 
-    return sr_register_body(ctx, b);
+/* Copies the body and hot entries at sorted position from to position to */
+void sr_copy_hot(sr_Context *ctx, int to, int from) {
+    ctx->bodies_sorted[to] = ctx->bodies_sorted[from];
+    ctx->sweep_pos[ctx->bodies_sorted[to]] = to;
+    ctx->hot_sweep_min[to] = ctx->hot_sweep_min[from];
+    ctx->hot_sweep_max[to] = ctx->hot_sweep_max[from];
+    ctx->hot_cross_min[to] = ctx->hot_cross_min[from];
+    ctx->hot_cross_max[to] = ctx->hot_cross_max[from];
+    ctx->hot_flags[to] = ctx->hot_flags[from];
+    ctx->hot_category[to] = ctx->hot_category[from];
+    ctx->hot_mask[to] = ctx->hot_mask[from];
 }
 
-sr_Body_Id sr_register_body(sr_Context *ctx, sr_Body b) {
-    void *realloc_out;
-    sr_Body_Id *bodies_sorted_temp;
-    sr_Body_Tick_Data *bodies_tick_data_temp;
-    sr_Body_Id next_id;
+/* Moves a body that moved in the last pass to its new place in the sweep order and stores its rect */
+void sr_reinsert_moved(sr_Context *ctx, sr_Body_Id id) {
+    sr_Scalar key;
+    int p, q;
 
-    if (ctx == NULL) {
-        return -1;
+    p = ctx->sweep_pos[id];
+    key = ctx->sweep_direction == SR_SWEEP_X ? ctx->bodies[id].r.min.x : ctx->bodies[id].r.min.y;
+
+    for (q = p; q > 0 && ctx->hot_sweep_min[q - 1] > key; --q) {
+        sr_copy_hot(ctx, q, q - 1);
+    }
+    if (q == p) {
+        for (; q + 1 < ctx->num_sweep && ctx->hot_sweep_min[q + 1] < key; ++q) {
+            sr_copy_hot(ctx, q, q + 1);
+        }
     }
 
-    next_id = ctx->num_bodies;
+    ctx->bodies_sorted[q] = id;
+    ctx->sweep_pos[id] = q;
+    sr_store_hot(ctx, q);
+}
 
-    if (ctx->num_bodies >= ctx->bodies_cap) {
-        realloc_out = SR_REALLOC(SR_ALLOC_CONTEXT, ctx->bodies, 2 * sizeof(sr_Body) * ctx->num_bodies + 2 * sizeof(sr_Body_Id) * ctx->num_bodies + 2 * sizeof(sr_Body_Tick_Data) * ctx->num_bodies);
-        if (realloc_out == NULL) {
-            return -1;
-        } else {
-            ctx->bodies = realloc_out;
-            bodies_sorted_temp = (sr_Body_Id *)(ctx->bodies + ctx->num_bodies);
-            bodies_tick_data_temp = (sr_Body_Tick_Data *)(bodies_sorted_temp + ctx->num_bodies);
+/* Resolves the pairs with a body that moved in the last pass again, in the sweep order kept from that pass */
 
-            ctx->bodies_sorted = (sr_Body_Id *)(ctx->bodies + ctx->num_bodies * 2);
-            ctx->bodies_tick_data = (sr_Body_Tick_Data *)(ctx->bodies_sorted + ctx->num_bodies * 2);
-            memcpy(ctx->bodies_tick_data, bodies_tick_data_temp, ctx->num_bodies * sizeof(sr_Body_Tick_Data));
-            memcpy(ctx->bodies_sorted, bodies_sorted_temp, ctx->num_bodies * sizeof(sr_Body_Id));
-            ctx->bodies_cap = ctx->num_bodies * 2;
+void sr_resolve_moved(sr_Context *ctx) {
+    sr_Body_Id id;
+    int i, j, k;
+
+    /* the tree doesn't sort, so its first pass leaves no order to keep */
+    if (!ctx->sweep_indexed) {
+        sr_stable_sort(ctx, ctx->bodies_sorted, ctx->num_sweep);
+        sr_gather_hot(ctx);
+        sr_index_sweep(ctx);
+    }
+
+    /* a body's length can round differently where it moved to, so the reach grows to cover it */
+    for (id = sr_next_moved(ctx, 0); id != -1; id = sr_next_moved(ctx, id + 1)) {
+        sr_reinsert_moved(ctx, id);
+        i = ctx->sweep_pos[id];
+        if (ctx->hot_sweep_max[i] - ctx->hot_sweep_min[i] > ctx->sweep_extent) {
+            ctx->sweep_extent = ctx->hot_sweep_max[i] - ctx->hot_sweep_min[i];
+        }
+    }
+
+    for (id = sr_next_moved(ctx, 0); id != -1; id = sr_next_moved(ctx, id + 1)) {
+        i = ctx->sweep_pos[id];
+        for (j = i + 1; j < ctx->num_sweep && ctx->hot_sweep_min[j] <= ctx->hot_sweep_max[i]; ++j) {
+            sr_resolve_hot_pair(ctx, i, j);
+        }
+        for (j = i - 1; j >= 0 && ctx->hot_sweep_min[i] - ctx->hot_sweep_min[j] <= ctx->sweep_extent; --j) {
+            if (ctx->hot_sweep_max[j] >= ctx->hot_sweep_min[i] && ctx->hot_sweep_max[j] - ctx->hot_sweep_min[j] <= ctx->sweep_extent &&
+                !sr_did_body_move(ctx, ctx->bodies_sorted[j])) {
+                sr_resolve_hot_pair(ctx, j, i);
+            }
+        }
+        for (k = 0; k < ctx->num_sweep_long; ++k) {
+            j = ctx->sweep_pos[ctx->sweep_long[k]];
+            if (j < i && ctx->hot_sweep_max[j] >= ctx->hot_sweep_min[i] && ctx->hot_sweep_max[j] - ctx->hot_sweep_min[j] > ctx->sweep_extent) {
+                sr_resolve_hot_pair(ctx, j, i);
+            }
         }
     }
 
-    ctx->bodies[next_id] = b;
-    ctx->bodies_sorted[next_id] = next_id;
-    ++ctx->num_bodies;
+    for (id = sr_next_moved(ctx, 0); id != -1; id = sr_next_moved(ctx, id + 1)) {
+        if (ctx->bodies[id].flags & (SR_DISABLED | SR_NO_COLLISION)) {
+            continue;
+        }
 
-    return next_id;
+        if (ctx->options & SR_OPTION_STATIC_INDEX) {
+            sr_resolve_static_index(ctx, id);
+        }
+        if (ctx->tiles != NULL) {
+#ifdef SR_STATS
+            sr_resolve_tiles(ctx, id, &(ctx->stats.pairs_visited), &(ctx->stats.pairs_overlapping));
+#else
+            sr_resolve_tiles(ctx, id, NULL, NULL);
+#endif
+        }
+    }
 }
 
-int sr_place_body(sr_Context *ctx, sr_Body_Id id, float xpos, float ypos) {
-    sr_Vec2 min_to_max;
-
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else if (ctx->bodies[id].flags & SR_DISABLED) {
-        return 0;
-    } else {
-        min_to_max.x = ctx->bodies[id].r.max.x - ctx->bodies[id].r.min.x;
-        min_to_max.y = ctx->bodies[id].r.max.y - ctx->bodies[id].r.min.y;
+void sr_resolve_collisions(sr_Context *ctx) {
+    sr_Contact *contacts;
+    int i;
 
-        ctx->bodies[id].r.min.x = xpos - ctx->bodies[id].offset.x;
-        ctx->bodies[id].r.min.y = ypos - ctx->bodies[id].offset.y;
+#ifdef SR_STATS
+    memset(&(ctx->stats), 0, sizeof(ctx->stats));
+    if (ctx->clock != NULL) {
+        ctx->phase_start = ctx->clock(ctx->clock_user);
+    }
+#endif
 
-        ctx->bodies[id].r.max.x = min_to_max.x + ctx->bodies[id].r.min.x;
-        ctx->bodies[id].r.max.y = min_to_max.y + ctx->bodies[id].r.min.y;
+    sr_drop_removed(ctx);
 
-        return 0;
+    if (ctx->options & SR_OPTION_CONTACTS) {
+        contacts = ctx->prev_contacts;
+        ctx->prev_contacts = ctx->contacts;
+        ctx->contacts = contacts;
+        ctx->num_prev_contacts = ctx->num_contacts;
+        ctx->num_contacts = 0;
+        ctx->num_dropped_contacts = 0;
     }
-}
 
-int sr_translate_body(sr_Context *ctx, sr_Body_Id id, float xmove, float ymove) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else if (ctx->bodies[id].flags & SR_DISABLED || ctx->bodies[id].priority == SR_PRIORITY_STATIC) {
-        return 0;
+    if (ctx->options & SR_OPTION_SLEEP) {
+        sr_begin_sleep_tick(ctx);
     } else {
-        ctx->bodies[id].r.min.x += xmove;
-        ctx->bodies[id].r.min.y += ymove;
-        ctx->bodies[id].r.max.x += xmove;
-        ctx->bodies[id].r.max.y += ymove;
+        memset(ctx->bodies_tick_data, 0, sizeof(sr_Body_Tick_Data) * ctx->num_bodies);
+    }
 
-        return 0;
+    if (ctx->options & SR_OPTION_STATIC_INDEX && ctx->static_dirty) {
+        sr_rebuild_static_index(ctx);
     }
-}
+    SR_STAT(sr_end_phase(ctx, &(ctx->stats.time_clear));)
 
-int sr_get_body_pos(sr_Vec2 *pos_out, const sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
+    sr_resolve_continuous_bodies(ctx);
+    if (ctx->iterations > 1) {
+        sr_begin_passes(ctx);
+    }
+    SR_STAT(sr_end_phase(ctx, &(ctx->stats.time_resolve));)
+
+    if (ctx->sweep_direction == SR_BROADPHASE_GRID) {
+        sr_grid_resolve(ctx);
+    } else if (ctx->sweep_direction == SR_BROADPHASE_TREE) {
+        sr_tree_resolve(ctx);
     } else {
-        pos_out->x = ctx->bodies[id].r.min.x + ctx->bodies[id].offset.x;
-        pos_out->y = ctx->bodies[id].r.min.y + ctx->bodies[id].offset.y;
+        sr_sweep_resolve(ctx);
+    }
 
-        return 0;
+    /* the tree broadphase already walked its dynamic tree against the static one */
+    if (ctx->options & SR_OPTION_STATIC_INDEX && ctx->sweep_direction != SR_BROADPHASE_TREE) {
+        if (ctx->parallel_for != NULL && sr_parallel_find_pairs(ctx, SR_STAGE_STATIC, ctx->num_sweep) == 0) {
+            if (sr_resolve_islands(ctx) != 0) {
+                sr_resolve_pair_chunks(ctx);
+            }
+            SR_STAT(sr_add_chunk_stats(ctx);)
+        } else {
+            for (i = 0; i < ctx->num_sweep; ++i) {
+                if (!(ctx->bodies[ctx->bodies_sorted[i]].flags & (SR_DISABLED | SR_NO_COLLISION))) {
+                    sr_resolve_static_index(ctx, ctx->bodies_sorted[i]);
+                }
+            }
+        }
     }
-}
 
-int sr_get_body_pos_comp(float *xpos_out, float *ypos_out, const sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else {
-        *xpos_out = ctx->bodies[id].r.min.x + ctx->bodies[id].offset.x;
-        *ypos_out = ctx->bodies[id].r.min.y + ctx->bodies[id].offset.y;
+    sr_resolve_tilemap(ctx);
 
-        return 0;
+    SR_STAT(ctx->stats.num_passes = 1;)
+    for (i = 1; i < ctx->iterations && sr_end_pass(ctx) > 0; ++i) {
+        sr_resolve_moved(ctx);
+        SR_STAT(++ctx->stats.num_passes;)
     }
-}
 
-int sr_get_body_dim(sr_Vec2 *dim_out, const sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else {
-        dim_out->x = ctx->bodies[id].r.max.x - ctx->bodies[id].r.min.x;
-        dim_out->y = ctx->bodies[id].r.max.y - ctx->bodies[id].r.min.y;
+    if (ctx->options & SR_OPTION_SLEEP) {
+        sr_end_sleep_tick(ctx);
+    }
 
-        return 0;
+    for (i = 0; i < ctx->num_bodies; ++i) {
+        if (ctx->bodies[i].r.min.x != ctx->prev_min[i].x || ctx->bodies[i].r.min.y != ctx->prev_min[i].y) {
+            sr_tree_mark_moved(ctx, i);
+            ctx->query_dirty = 1;
+        }
+        ctx->prev_min[i] = ctx->bodies[i].r.min;
+        SR_STAT(ctx->stats.num_active += !(ctx->bodies[i].flags & SR_DISABLED) && !(ctx->bodies_tick_data[i].flags & SR_ASLEEP);)
     }
-}
 
-int sr_get_body_dim_comp(float *xdim_out, float *ydim_out, const sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else {
-        *xdim_out = ctx->bodies[id].r.max.x - ctx->bodies[id].r.min.x;
-        *ydim_out = ctx->bodies[id].r.max.y - ctx->bodies[id].r.min.y;
+    if (ctx->options & SR_OPTION_CONTACTS) {
+        sr_update_contact_events(ctx);
+    }
+    SR_STAT(sr_end_phase(ctx, &(ctx->stats.time_resolve));)
+}
 
-        return 0;
+/* Points the arrays of world into mem and returns the bytes they and the rooms take, mem may be NULL to only get the size */
+size_t sr_world_carve(sr_World *world, void *mem, const int *room_bodies, int num_rooms, sr_Sweep_Direction sdir, unsigned int options) {
+    size_t at;
+    int i;
+
+    at = 0;
+    world->rooms = sr_carve_array(mem, &at, num_rooms * sizeof(sr_Context));
+    world->room_order = sr_carve_array(mem, &at, num_rooms * sizeof(int));
+    world->room_tasks = sr_carve_array(mem, &at, num_rooms * sizeof(int));
+    world->task_rooms = sr_carve_array(mem, &at, num_rooms * sizeof(int));
+    for (i = 0; i < num_rooms; ++i) {
+        if (mem != NULL) {
+            sr_context_init_with_memory(&(world->rooms[i]), (char *)mem + at, sr_context_memory_size(room_bodies[i], sdir, options), sdir, options);
+        }
+        sr_carve_array(mem, &at, sr_context_memory_size(room_bodies[i], sdir, options));
     }
+
+    return at;
 }
 
-int sr_get_body_rect(sr_Rect *rect_out, const sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
+int sr_world_init(sr_World *world, const int *room_bodies, int num_rooms, sr_Sweep_Direction sdir, unsigned int options) {
+    sr_World layout;
+    void *mem;
+    int i;
+    SR_ASSERT(world != NULL && "cannot initialize null pointer");
+
+    world->memory = NULL;
+    if (num_rooms < 1) {
         return -1;
-    } else {
-        *rect_out = ctx->bodies[id].r;
-        return 0;
     }
-}
 
-int sr_get_body_rect_comp(float *xmin_out, float *ymin_out, float *xmax_out, float *ymax_out, const sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
+    mem = SR_REALLOC(SR_ALLOC_CONTEXT, NULL, sr_world_carve(&layout, NULL, room_bodies, num_rooms, sdir, options));
+    if (mem == NULL) {
         return -1;
-    } else {
-        *xmin_out = ctx->bodies[id].r.min.x;
-        *ymin_out = ctx->bodies[id].r.min.y;
-        *xmax_out = ctx->bodies[id].r.max.x;
-        *ymax_out = ctx->bodies[id].r.max.y;
+    }
 
-        return 0;
+    sr_world_carve(world, mem, room_bodies, num_rooms, sdir, options);
+    world->memory = mem;
+    world->num_rooms = num_rooms;
+    world->task_ends = NULL;
+    world->task_loads = NULL;
+    world->num_tasks = 0;
+    world->parallel_for = NULL;
+    world->parallel_user = NULL;
+
+    for (i = 0; i < num_rooms; ++i) {
+        world->room_order[i] = i;
+        world->room_tasks[i] = 0;
+        world->task_rooms[i] = i;
     }
+
+    return 0;
 }
 
-int sr_do_bodies_overlap(sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
-    if (id1 >= ctx->num_bodies || id2 >= ctx->num_bodies) {
-        return -1;
-    } else {
-        return sr_do_rects_overlap(ctx->bodies[id1].r, ctx->bodies[id2].r);
+void sr_world_deinit(sr_World *world) {
+    int i;
+
+    for (i = 0; i < world->num_rooms; ++i) {
+        sr_context_deinit(&(world->rooms[i]));
     }
+    sr_world_set_parallel_for(world, NULL, NULL, 0);
+    SR_FREE(SR_ALLOC_CONTEXT, world->memory);
+    world->memory = NULL;
+    world->rooms = NULL;
+    world->num_rooms = 0;
 }
 
-int sr_get_body_to_body_vector(sr_Vec2 *vec_out, sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
-    if (id1 >= ctx->num_bodies || id2 >= ctx->num_bodies) {
-        return -1;
-    } else {
-        vec_out->x = (ctx->bodies[id2].r.max.x + ctx->bodies[id2].r.min.x) / 2 - (ctx->bodies[id1].r.max.x + ctx->bodies[id1].r.min.x) / 2;
-        vec_out->y = (ctx->bodies[id2].r.max.y + ctx->bodies[id2].r.min.y) / 2 - (ctx->bodies[id1].r.max.y + ctx->bodies[id1].r.min.y) / 2;
-
-        return 0;
+sr_Context *sr_world_get_room(sr_World *world, int room) {
+    if (room < 0 || room >= world->num_rooms) {
+        return NULL;
     }
+
+    return &(world->rooms[room]);
 }
 
-int sr_get_body_to_body_vector_comp(float *xvec_out, float *yvec_out, sr_Context *ctx, sr_Body_Id id1, sr_Body_Id id2) {
-    if (id1 >= ctx->num_bodies || id2 >= ctx->num_bodies) {
-        return -1;
-    } else {
-        *xvec_out = (ctx->bodies[id2].r.max.x + ctx->bodies[id2].r.min.x) / 2 - (ctx->bodies[id1].r.max.x + ctx->bodies[id1].r.min.x) / 2;
-        *yvec_out = (ctx->bodies[id2].r.max.y + ctx->bodies[id2].r.min.y) / 2 - (ctx->bodies[id1].r.max.y + ctx->bodies[id1].r.min.y) / 2;
+int sr_world_set_parallel_for(sr_World *world, sr_Parallel_For parallel_for, void *user, int num_tasks) {
+    SR_FREE(SR_ALLOC_CONTEXT, world->task_ends);
+    SR_FREE(SR_ALLOC_CONTEXT, world->task_loads);
+    world->task_ends = NULL;
+    world->task_loads = NULL;
+    world->num_tasks = 0;
+    world->parallel_for = NULL;
+    world->parallel_user = NULL;
 
+    if (parallel_for == NULL) {
         return 0;
+    } else if (num_tasks <= 0) {
+        return -1;
     }
-}
 
-int sr_get_body_tick_data(sr_Body_Tick_Data *data_out, sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
+    world->task_ends = SR_REALLOC(SR_ALLOC_CONTEXT, NULL, num_tasks * sizeof(int));
+    world->task_loads = SR_REALLOC(SR_ALLOC_CONTEXT, NULL, num_tasks * sizeof(long));
+    if (world->task_ends == NULL || world->task_loads == NULL) {
+        sr_world_set_parallel_for(world, NULL, NULL, 0);
         return -1;
     } else {
-        *data_out = ctx->bodies_tick_data[id];
+        world->num_tasks = num_tasks;
+        world->parallel_for = parallel_for;
+        world->parallel_user = user;
 
         return 0;
     }
 }
 
-int sr_did_body_collide(sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else {
-        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED) {
-            return 1;
-        } else {
-            return 0;
+/* Hands the rooms to the tasks, largest first, each to the task with the fewest bodies so far */
+
+void sr_world_balance(sr_World *world) {
+    int i, k, room, best, count;
+
+    /* the order from the last step is almost right, so an insertion sort is cheap */
+    for (i = 1; i < world->num_rooms; ++i) {
+        room = world->room_order[i];
+        for (k = i; k > 0 && world->rooms[world->room_order[k - 1]].num_bodies < world->rooms[room].num_bodies; --k) {
+            world->room_order[k] = world->room_order[k - 1];
         }
+        world->room_order[k] = room;
     }
-}
 
-int sr_did_body_collide_wall(sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else {
-        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_RIGHT_WALL || ctx->bodies_tick_data[id].flags & SR_COLLIDED_LEFT_WALL) {
-            return 1;
-        } else {
-            return 0;
-        }
+    for (i = 0; i < world->num_tasks; ++i) {
+        world->task_loads[i] = 0;
+        world->task_ends[i] = 0;
     }
-}
 
-int sr_did_body_collide_ceiling(sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else {
-        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_CEILING) {
-            return 1;
-        } else {
-            return 0;
+    for (i = 0; i < world->num_rooms; ++i) {
+        room = world->room_order[i];
+        best = 0;
+        for (k = 1; k < world->num_tasks; ++k) {
+            if (world->task_loads[k] < world->task_loads[best]) {
+                best = k;
+            }
         }
+        /* empty rooms still cost a little */
+        world->task_loads[best] += world->rooms[room].num_bodies + 1;
+        world->room_tasks[room] = best;
+        ++world->task_ends[best];
     }
-}
 
-int sr_did_body_collide_right_wall(sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else {
-        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_RIGHT_WALL) {
-            return 1;
-        } else {
-            return 0;
-        }
+    /* task_ends holds the starts while scattering and the ends afterwards */
+    count = 0;
+    for (i = 0; i < world->num_tasks; ++i) {
+        k = world->task_ends[i];
+        world->task_ends[i] = count;
+        count += k;
     }
-}
 
-int sr_did_body_collide_floor(sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else {
-        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_FLOOR) {
-            return 1;
-        } else {
-            return 0;
-        }
+    for (i = 0; i < world->num_rooms; ++i) {
+        room = world->room_order[i];
+        world->task_rooms[world->task_ends[world->room_tasks[room]]++] = room;
     }
 }
 
-int sr_did_body_collide_left_wall(sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else {
-        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_LEFT_WALL) {
-            return 1;
-        } else {
-            return 0;
-        }
+void sr_world_step_task(void *task_data, int index) {
+    sr_World *world;
+    int k;
+
+    world = task_data;
+    for (k = index == 0 ? 0 : world->task_ends[index - 1]; k < world->task_ends[index]; ++k) {
+        sr_resolve_collisions(&(world->rooms[world->task_rooms[k]]));
     }
 }
 
-int sr_did_body_collide_up(sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else {
-        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_UP) {
-            return 1;
-        } else {
-            return 0;
+void sr_world_step(sr_World *world) {
+    int i;
+
+    if (world->parallel_for == NULL) {
+        for (i = 0; i < world->num_rooms; ++i) {
+            sr_resolve_collisions(&(world->rooms[i]));
         }
+    } else {
+        sr_world_balance(world);
+        world->parallel_for(world->parallel_user, sr_world_step_task, world, world->num_tasks);
     }
 }
 
-int sr_did_body_collide_right(sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
+int sr_world_get_room_task(const sr_World *world, int room) {
+    if (room < 0 || room >= world->num_rooms) {
         return -1;
-    } else {
-        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_RIGHT) {
-            return 1;
-        } else {
-            return 0;
-        }
     }
+
+    return world->room_tasks[room];
 }
 
-int sr_did_body_collide_down(sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
-        return -1;
-    } else {
-        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_DOWN) {
-            return 1;
-        } else {
-            return 0;
-        }
-    }
+#ifdef SR_STATS
+void sr_context_set_clock(sr_Context *ctx, sr_Clock clock, void *user) {
+    ctx->clock = clock;
+    ctx->clock_user = user;
 }
 
-int sr_did_body_collide_left(sr_Context *ctx, sr_Body_Id id) {
-    if (id >= ctx->num_bodies) {
+int sr_get_tick_stats(sr_Tick_Stats *stats_out, const sr_Context *ctx) {
+    if (ctx == NULL) {
         return -1;
-    } else {
-        if (ctx->bodies_tick_data[id].flags & SR_COLLIDED_LEFT) {
-            return 1;
-        } else {
-            return 0;
-        }
     }
-}
-
-void sr_resolve_collisions(sr_Context *ctx) {
-    int i, j;
 
-    memset(ctx->bodies_tick_data, 0, sizeof(sr_Body_Tick_Data) * ctx->num_bodies);
+    *stats_out = ctx->stats;
 
-    sr_stable_sort(ctx);
+    return 0;
+}
 
-#define SR_B(ind) (ctx->bodies[ctx->bodies_sorted[ind]])
-    if (ctx->sweep_direction == SR_SWEEP_X) {
+void sr_world_set_clock(sr_World *world, sr_Clock clock, void *user) {
+    int i;
 
-    for (i = 0; i < ctx->num_bodies; ++i) {
-        if (SR_B(i).flags & SR_DISABLED) {
-            continue;
-        }
-        for (j = i + 1; j < ctx->num_bodies; ++j) {
-            if (SR_B(j).r.min.x > SR_B(i).r.max.x) {
-                break;
-            } else if (SR_B(j).flags & SR_DISABLED) {
-                continue;
-            } else {
-                if (sr_do_rects_overlap(SR_B(i).r, SR_B(j).r)) {
-                    sr_resolve_bodies(ctx, ctx->bodies_sorted[i], ctx->bodies_sorted[j]);
-                }
-            }
-        }
+    for (i = 0; i < world->num_rooms; ++i) {
+        sr_context_set_clock(&(world->rooms[i]), clock, user);
     }
+}
 
-    } else {
-
-    for (i = 0; i < ctx->num_bodies; ++i) {
-        if (SR_B(i).flags & SR_DISABLED || SR_B(i).flags & SR_NO_COLLISION) {
-            continue;
-        }
-        for (j = i + 1; j < ctx->num_bodies; ++j) {
-            if (SR_B(j).r.min.y > SR_B(i).r.max.y) {
-                break;
-            } else if (SR_B(j).flags & SR_DISABLED || SR_B(j).flags & SR_NO_COLLISION) {
-                continue;
-            } else {
-                if (sr_do_rects_overlap(SR_B(i).r, SR_B(j).r)) {
-                    sr_resolve_bodies(ctx, ctx->bodies_sorted[i], ctx->bodies_sorted[j]);
-                }
-            }
-        }
+int sr_world_get_room_stats(sr_Tick_Stats *stats_out, const sr_World *world, int room) {
+    if (room < 0 || room >= world->num_rooms) {
+        return -1;
     }
 
-    }
-#undef SR_B
+    return sr_get_tick_stats(stats_out, &(world->rooms[room]));
 }
+#endif
 
 #endif /* #ifdef SRECT_IMPLEMENTATION */
 
@@ -0,0 +1,475 @@
+/*
+Tests for srect.h, only needs srect.h:
+
+    cc -I.. test.c -o test
+    ./test
+
+Prints every failed check and exits with 1 if there was one.
+*/
+
+#define SRECT_IMPLEMENTATION
+#include "srect.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_BODIES 2000
+
+#define TEST_CHECK(cond) test_check((cond), #cond, __FILE__, __LINE__)
+
+typedef struct {
+    sr_Context ctx;
+    sr_Body_Id ids[TEST_BODIES];
+    int num_ids;
+    float width;
+    unsigned long seed;
+} test_Scene;
+
+int test_failures = 0;
+
+void test_check(int ok, const char *cond, const char *file, int line) {
+    if (!ok) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, cond);
+        ++test_failures;
+    }
+}
+
+/* Runs the tasks one after the other, which is enough to take the parallel paths */
+void test_parallel_for(void *user, sr_Task_Fn fn, void *task_data, int count) {
+    int i;
+
+    (void)user;
+    for (i = 0; i < count; ++i) {
+        fn(task_data, i);
+    }
+}
+
+float test_rand(test_Scene *s) {
+    s->seed = (s->seed * 1103515245ul + 12345ul) & 0xFFFFFFFFul;
+
+    return (float)((s->seed >> 8) & 0xFFFFu) / 65536.0f;
+}
+
+/* The crowd scene of bench.c: agents packed at about half density */
+void test_crowd_init(test_Scene *s, sr_Sweep_Direction sdir, unsigned int options) {
+    int side;
+
+    side = 1;
+    while ((side + 1) * (side + 1) <= TEST_BODIES) {
+        ++side;
+    }
+    s->width = (float)side * 14.0f;
+    s->seed = 1;
+    s->num_ids = 0;
+
+    sr_context_init(&(s->ctx), TEST_BODIES, sdir);
+    sr_context_set_options(&(s->ctx), options);
+    while (s->num_ids < TEST_BODIES) {
+        s->ids[s->num_ids] = sr_new_body(&(s->ctx), test_rand(s) * s->width, test_rand(s) * s->width, 10.0f, 10.0f, SR_TOP_LEFT, (int)(test_rand(s) * 4), 0, 0);
+        ++s->num_ids;
+    }
+}
+
+/* Walks every agent towards the center */
+void test_crowd_tick(test_Scene *s) {
+    sr_Vec2 pos;
+    int i;
+
+    for (i = 0; i < s->num_ids; ++i) {
+        if (sr_get_body_pos(&pos, &(s->ctx), s->ids[i]) == 0) {
+            sr_translate_body(&(s->ctx), s->ids[i], pos.x < s->width / 2.0f ? 0.5f : -0.5f, pos.y < s->width / 2.0f ? 0.5f : -0.5f);
+        }
+    }
+}
+
+/* Returns 1 if both scenes hold the same rects and tick flags */
+int test_bodies_equal(test_Scene *a, test_Scene *b) {
+    sr_Body_Tick_Data ta, tb;
+    sr_Rect ra, rb;
+    int i;
+
+    for (i = 0; i < a->num_ids; ++i) {
+        if (sr_get_body_rect(&ra, &(a->ctx), a->ids[i]) != 0 || sr_get_body_rect(&rb, &(b->ctx), b->ids[i]) != 0 ||
+            ra.min.x != rb.min.x || ra.min.y != rb.min.y || ra.max.x != rb.max.x || ra.max.y != rb.max.y) {
+            return 0;
+        }
+        if (sr_get_body_tick_data(&ta, &(a->ctx), a->ids[i]) != 0 || sr_get_body_tick_data(&tb, &(b->ctx), b->ids[i]) != 0 ||
+            ta.flags != tb.flags || ta.custom_flags != tb.custom_flags) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Returns 1 if both scenes hold the same rects, tick flags and contacts */
+int test_scenes_equal(test_Scene *a, test_Scene *b) {
+    const sr_Contact *ca, *cb;
+    int i, na, nb;
+
+    if (!test_bodies_equal(a, b)) {
+        return 0;
+    }
+
+    na = 0;
+    nb = 0;
+    sr_get_contacts(&ca, &na, &(a->ctx));
+    sr_get_contacts(&cb, &nb, &(b->ctx));
+    if (na != nb) {
+        return 0;
+    }
+    for (i = 0; i < na; ++i) {
+        if (ca[i].id1 != cb[i].id1 || ca[i].id2 != cb[i].id2 || ca[i].direction != cb[i].direction || ca[i].penetration != cb[i].penetration) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* The islands of the parallel sweep resolve the crowd exactly like the single-threaded sweep */
+void test_parallel_sweep(void) {
+    static test_Scene serial, parallel;
+    static const unsigned int options[] = {0, SR_OPTION_CONTACTS, SR_OPTION_CONTACTS | SR_OPTION_SLEEP | SR_OPTION_STATIC_INDEX};
+    static const int tasks[] = {1, 4, 13};
+    int o, t, tick, equal;
+
+    for (o = 0; o < 3; ++o) {
+        for (t = 0; t < 3; ++t) {
+            test_crowd_init(&serial, SR_SWEEP_X, options[o]);
+            test_crowd_init(&parallel, SR_SWEEP_X, options[o]);
+            sr_context_set_parallel_for(&(parallel.ctx), test_parallel_for, NULL, tasks[t]);
+
+            equal = 1;
+            for (tick = 0; tick < 30 && equal; ++tick) {
+                test_crowd_tick(&serial);
+                test_crowd_tick(&parallel);
+                sr_resolve_collisions(&(serial.ctx));
+                sr_resolve_collisions(&(parallel.ctx));
+                equal = test_scenes_equal(&serial, &parallel);
+            }
+            TEST_CHECK(equal);
+
+            sr_context_deinit(&(serial.ctx));
+            sr_context_deinit(&(parallel.ctx));
+        }
+    }
+}
+
+/* Returns 1 if both scenes hold the same rects and tick flags, and the same contacts in any order */
+int test_scenes_match(test_Scene *a, test_Scene *b) {
+    const sr_Contact *ca, *cb;
+    int i, j, na, nb;
+
+    if (!test_bodies_equal(a, b)) {
+        return 0;
+    }
+
+    na = 0;
+    nb = 0;
+    sr_get_contacts(&ca, &na, &(a->ctx));
+    sr_get_contacts(&cb, &nb, &(b->ctx));
+    if (na != nb) {
+        return 0;
+    }
+    for (i = 0; i < na; ++i) {
+        for (j = 0; j < nb; ++j) {
+            if (ca[i].id1 == cb[j].id1 && ca[i].id2 == cb[j].id2 && ca[i].direction == cb[j].direction && ca[i].penetration == cb[j].penetration) {
+                break;
+            }
+        }
+        if (j == nb) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Registers the bodies of pair i under ids[2 * i] and ids[2 * i + 1] */
+void test_pair_new(test_Scene *s, int i) {
+    s->ids[2 * i] = sr_new_body(&(s->ctx), (float)(i % 30) * 250.0f, (float)(i / 30) * 40.0f, 10.0f, 10.0f, SR_TOP_LEFT, 0, 0, 0);
+    s->ids[2 * i + 1] = sr_new_body(&(s->ctx), (float)(i % 30) * 250.0f + 12.0f, (float)(i / 30) * 40.0f + 3.0f, (float)(10 + i % 5 * 40), 10.0f, SR_TOP_LEFT, 0, 0, 0);
+}
+
+/* Returns 1 if contacts[0, count) holds a contact between the bodies of c */
+int test_has_contact(const sr_Contact *contacts, int count, const sr_Contact *c) {
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        if (contacts[i].id1 == c->id1 && contacts[i].id2 == c->id2) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Pairs of bodies far apart, the first of each pair walks into the second, which spans up to four grid cells */
+void test_pairs_init(test_Scene *s, sr_Sweep_Direction sdir, unsigned int options) {
+    int i;
+
+    s->width = 0.0f;
+    s->seed = 1;
+    s->num_ids = 0;
+
+    sr_context_init(&(s->ctx), TEST_BODIES, sdir);
+    sr_context_set_options(&(s->ctx), options);
+    for (i = 0; i < TEST_BODIES / 2; ++i) {
+        test_pair_new(s, i);
+        s->num_ids += 2;
+    }
+}
+
+/* Walks the first body of every pair one step */
+void test_pairs_tick(test_Scene *s) {
+    int i;
+
+    for (i = 0; i < s->num_ids; i += 2) {
+        sr_translate_body(&(s->ctx), s->ids[i], 1.0f, 0.0f);
+    }
+}
+
+/* When no resolution pushes a body into a third one, the passes after the first change nothing */
+void test_iterations(void) {
+    static test_Scene single, multi;
+    static const sr_Sweep_Direction sdirs[] = {SR_SWEEP_X, SR_SWEEP_Y};
+    int d, tick, equal;
+
+    for (d = 0; d < 2; ++d) {
+        test_pairs_init(&single, sdirs[d], SR_OPTION_CONTACTS);
+        test_pairs_init(&multi, sdirs[d], SR_OPTION_CONTACTS);
+        sr_context_set_iterations(&(multi.ctx), 4);
+
+        equal = 1;
+        for (tick = 0; tick < 30 && equal; ++tick) {
+            test_pairs_tick(&single);
+            test_pairs_tick(&multi);
+            sr_resolve_collisions(&(single.ctx));
+            sr_resolve_collisions(&(multi.ctx));
+            equal = test_scenes_equal(&single, &multi);
+        }
+        TEST_CHECK(equal);
+
+        sr_context_deinit(&(single.ctx));
+        sr_context_deinit(&(multi.ctx));
+    }
+}
+
+/* Every broadphase finds the pairs the y sweep finds, the grid even in the same order */
+void test_broadphases(void) {
+    static test_Scene sweep, other;
+    static const sr_Sweep_Direction sdirs[] = {SR_SWEEP_X, SR_BROADPHASE_GRID, SR_BROADPHASE_TREE};
+    int d, tick, equal;
+
+    for (d = 0; d < 3; ++d) {
+        test_pairs_init(&sweep, SR_SWEEP_Y, SR_OPTION_CONTACTS);
+        test_pairs_init(&other, sdirs[d], SR_OPTION_CONTACTS);
+
+        equal = 1;
+        for (tick = 0; tick < 30 && equal; ++tick) {
+            test_pairs_tick(&sweep);
+            test_pairs_tick(&other);
+            sr_resolve_collisions(&(sweep.ctx));
+            sr_resolve_collisions(&(other.ctx));
+            equal = sdirs[d] == SR_BROADPHASE_GRID ? test_scenes_equal(&sweep, &other) : test_scenes_match(&sweep, &other);
+        }
+        TEST_CHECK(equal);
+
+        sr_context_deinit(&(sweep.ctx));
+        sr_context_deinit(&(other.ctx));
+    }
+}
+
+/* Removed bodies' ids stay invalid, and bodies registered in their places behave like the ones they replace */
+void test_remove(void) {
+    static test_Scene kept, removed;
+    sr_Body_Id old[2], extra[50];
+    sr_Rect r;
+    int i, tick, equal;
+
+    test_pairs_init(&kept, SR_SWEEP_X, SR_OPTION_CONTACTS | SR_OPTION_SLEEP);
+    test_pairs_init(&removed, SR_SWEEP_X, SR_OPTION_CONTACTS | SR_OPTION_SLEEP);
+    for (i = 0; i < 50; ++i) {
+        extra[i] = sr_new_body(&(removed.ctx), (float)i * 20.0f, -100.0f, 10.0f, 10.0f, SR_TOP_LEFT, 0, 0, 0);
+    }
+
+    /* a third of the pairs comes back right away, another third after a tick */
+    for (i = 0; i < removed.num_ids / 2; ++i) {
+        if (i % 3 == 2) {
+            continue;
+        }
+        old[0] = removed.ids[2 * i];
+        old[1] = removed.ids[2 * i + 1];
+        TEST_CHECK(sr_remove_body(&(removed.ctx), old[0]) == 0);
+        TEST_CHECK(sr_remove_body(&(removed.ctx), old[1]) == 0);
+        TEST_CHECK(sr_remove_body(&(removed.ctx), old[0]) == -1);
+        TEST_CHECK(sr_get_body_rect(&r, &(removed.ctx), old[1]) == -1);
+        if (i % 3 == 0) {
+            test_pair_new(&removed, i);
+            TEST_CHECK(removed.ids[2 * i] != old[0] && removed.ids[2 * i] != old[1]);
+            TEST_CHECK(sr_get_body_rect(&r, &(removed.ctx), old[0]) == -1);
+        }
+    }
+    sr_resolve_collisions(&(kept.ctx));
+    sr_resolve_collisions(&(removed.ctx));
+    for (i = 1; i < removed.num_ids / 2; i += 3) {
+        test_pair_new(&removed, i);
+    }
+
+    equal = 1;
+    for (tick = 0; tick < 30 && equal; ++tick) {
+        test_pairs_tick(&kept);
+        test_pairs_tick(&removed);
+        sr_resolve_collisions(&(kept.ctx));
+        sr_resolve_collisions(&(removed.ctx));
+        equal = test_bodies_equal(&kept, &removed);
+        if (tick == 5) {
+            for (i = 0; i < 50; ++i) {
+                sr_remove_body(&(removed.ctx), extra[i]);
+            }
+        } else if (tick == 10) {
+            sr_context_compact(&(removed.ctx));
+            TEST_CHECK(removed.ctx.num_bodies == removed.num_ids);
+        }
+    }
+    TEST_CHECK(equal);
+
+    sr_context_deinit(&(kept.ctx));
+    sr_context_deinit(&(removed.ctx));
+}
+
+/* Restoring a snapshot, or a base and a delta, rewinds a context to exactly the state it was saved in */
+void test_snapshot(void) {
+    static test_Scene live, replay;
+    static const sr_Sweep_Direction sdirs[] = {SR_SWEEP_X, SR_BROADPHASE_TREE};
+    void *base, *delta;
+    size_t bytes;
+    int d, tick, equal;
+
+    for (d = 0; d < 2; ++d) {
+        test_crowd_init(&live, sdirs[d], SR_OPTION_CONTACTS | SR_OPTION_SLEEP);
+        test_crowd_init(&replay, sdirs[d], SR_OPTION_CONTACTS | SR_OPTION_SLEEP);
+        for (tick = 0; tick < 10; ++tick) {
+            test_crowd_tick(&live);
+            test_crowd_tick(&replay);
+            sr_resolve_collisions(&(live.ctx));
+            sr_resolve_collisions(&(replay.ctx));
+        }
+
+        bytes = sr_context_snapshot_size(&(replay.ctx)) + 4096;
+        base = malloc(bytes);
+        delta = malloc(bytes);
+        TEST_CHECK(base != NULL && delta != NULL && sr_context_save(base, bytes, &(replay.ctx)) == 0);
+
+        /* the replay runs ahead, is rewound to the base and has to catch up with the live context */
+        for (tick = 0; tick < 5; ++tick) {
+            test_crowd_tick(&replay);
+            sr_resolve_collisions(&(replay.ctx));
+        }
+        TEST_CHECK(sr_context_restore(&(replay.ctx), base) == 0);
+        equal = test_scenes_equal(&live, &replay);
+        for (tick = 0; tick < 5 && equal; ++tick) {
+            test_crowd_tick(&live);
+            test_crowd_tick(&replay);
+            sr_resolve_collisions(&(live.ctx));
+            sr_resolve_collisions(&(replay.ctx));
+            equal = test_scenes_equal(&live, &replay);
+        }
+        TEST_CHECK(equal);
+
+        /* the same through a delta against the base */
+        TEST_CHECK(sr_context_save_delta(delta, bytes, &(replay.ctx), base) == 0);
+        for (tick = 0; tick < 5; ++tick) {
+            test_crowd_tick(&replay);
+            sr_resolve_collisions(&(replay.ctx));
+        }
+        TEST_CHECK(sr_context_restore_delta(&(replay.ctx), base, delta) == 0);
+        equal = test_scenes_equal(&live, &replay);
+        for (tick = 0; tick < 5 && equal; ++tick) {
+            test_crowd_tick(&live);
+            test_crowd_tick(&replay);
+            sr_resolve_collisions(&(live.ctx));
+            sr_resolve_collisions(&(replay.ctx));
+            equal = test_scenes_equal(&live, &replay);
+        }
+        TEST_CHECK(equal);
+
+        free(base);
+        free(delta);
+        sr_context_deinit(&(live.ctx));
+        sr_context_deinit(&(replay.ctx));
+    }
+}
+
+/* A contact begins on the tick it is first recorded and ends on the first tick without it */
+void test_contact_events(void) {
+    static test_Scene s;
+    static sr_Contact prev[TEST_BODIES];
+    const sr_Contact *contacts, *begins, *ends;
+    int i, tick, num_prev, num_contacts, num_begins, num_ends, total_begins, total_ends;
+
+    test_pairs_init(&s, SR_SWEEP_X, SR_OPTION_CONTACTS);
+
+    num_prev = 0;
+    total_begins = 0;
+    total_ends = 0;
+    for (tick = 0; tick < 21; ++tick) {
+        if (tick < 20) {
+            test_pairs_tick(&s);
+        } else {
+            /* pulls the walking bodies back out of touch */
+            for (i = 0; i < s.num_ids; i += 2) {
+                sr_translate_body(&(s.ctx), s.ids[i], -5.0f, 0.0f);
+            }
+        }
+        sr_resolve_collisions(&(s.ctx));
+        contacts = NULL;
+        begins = NULL;
+        ends = NULL;
+        num_contacts = 0;
+        num_begins = 0;
+        num_ends = 0;
+        sr_get_contacts(&contacts, &num_contacts, &(s.ctx));
+        sr_get_contact_begins(&begins, &num_begins, &(s.ctx));
+        sr_get_contact_ends(&ends, &num_ends, &(s.ctx));
+
+        for (i = 0; i < num_begins; ++i) {
+            TEST_CHECK(test_has_contact(contacts, num_contacts, &(begins[i])) && !test_has_contact(prev, num_prev, &(begins[i])));
+        }
+        for (i = 0; i < num_ends; ++i) {
+            TEST_CHECK(test_has_contact(prev, num_prev, &(ends[i])) && !test_has_contact(contacts, num_contacts, &(ends[i])));
+        }
+        TEST_CHECK(num_contacts - num_begins == num_prev - num_ends);
+        TEST_CHECK(s.ctx.num_dropped_contacts == 0);
+
+        total_begins += num_begins;
+        total_ends += num_ends;
+        for (i = 0; i < num_contacts; ++i) {
+            prev[i] = contacts[i];
+        }
+        num_prev = num_contacts;
+    }
+    TEST_CHECK(total_begins == s.num_ids / 2);
+    TEST_CHECK(total_ends == s.num_ids / 2 && num_prev == 0);
+
+    sr_context_deinit(&(s.ctx));
+}
+
+int main(void) {
+    test_parallel_sweep();
+    test_iterations();
+    test_broadphases();
+    test_remove();
+    test_snapshot();
+    test_contact_events();
+
+    if (test_failures > 0) {
+        fprintf(stderr, "%d checks failed\n", test_failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+
+    return 0;
+}